@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "BankIndex.h"
+#include "JsonScanner.h"
+#include "guitarix.h"       // NOLINT
+#include <map>
+
+static const char cache_magic[] = "GXBANKIDX1";
+
+static std::map<juce::String, std::shared_ptr<const BankIndex>>& get_indexes()
+{
+    static std::map<juce::String, std::shared_ptr<const BankIndex>> indexes;
+    return indexes;
+}
+
+juce::File BankIndex::get_cache_file(const juce::File& bank)
+{
+    return bank.getSiblingFile("." + bank.getFileName() + ".idx");
+}
+
+std::shared_ptr<const BankIndex> BankIndex::get(const juce::File& bank)
+{
+    juce::int64 size = bank.getSize();
+    juce::int64 mtime = bank.getLastModificationTime().toMilliseconds();
+    if (!bank.existsAsFile())
+        return nullptr;
+    auto& indexes = get_indexes();
+    auto i = indexes.find(bank.getFullPathName());
+    if (i != indexes.end() && i->second->size == size && i->second->mtime == mtime)
+        return i->second;
+
+    std::shared_ptr<BankIndex> idx(new BankIndex(size, mtime));
+    juce::File cache = get_cache_file(bank);
+    if (!idx->read_cache(cache)) {
+        juce::MemoryMappedFile map(bank, juce::MemoryMappedFile::readOnly);
+        if (!map.getData() || !scan(static_cast<const char*>(map.getData()), map.getSize(), idx->entries))
+            return nullptr;
+        idx->write_cache(cache);
+    }
+    indexes[bank.getFullPathName()] = idx;
+    return idx;
+}
+
+void BankIndex::forget(const juce::File& bank)
+{
+    get_indexes().erase(bank.getFullPathName());
+    get_cache_file(bank).deleteFile();
+}
+
+std::vector<std::string> BankIndex::get_preset_names(gx_system::PresetFile& pf)
+{
+    std::vector<std::string> names;
+    if (auto idx = get(juce::File(pf.get_filename()))) {
+        names.reserve(idx->entries.size());
+        for (auto& e : idx->entries)
+            names.push_back(e.name);
+    } else {
+        for (auto p = pf.begin(); p != pf.end(); ++p)
+            names.push_back(p->name.raw());
+    }
+    return names;
+}
+
+const BankIndex::Entry *BankIndex::find(const std::string& name) const
+{
+    for (auto& e : entries)
+        if (e.name == name)
+            return &e;
+    return nullptr;
+}
+
+// top level of the bank, the preset objects are skipped over
+bool BankIndex::scan(const char *data, size_t size, std::vector<Entry>& entries, size_t *header_end)
+{
+    JsonScanner jp(data, size);
+    try {
+        jp.next(JsonScanner::begin_array);
+        jp.next(JsonScanner::value_string);
+        if (jp.current_value() != "gx_head_file_version")
+            return false;
+        jp.skip_object();
+        if (header_end)
+            *header_end = jp.get_token_offset() + 1;
+        while (jp.peek() == JsonScanner::value_string) {
+            jp.next();
+            Entry e { std::string(jp.current_value()), juce::int64(jp.get_next_offset()), 0 };
+            jp.skip_object();
+            e.length = juce::int64(jp.get_token_offset()) + 1 - e.offset;
+            entries.push_back(std::move(e));
+        }
+        jp.next(JsonScanner::end_array);
+    } catch (JsonScanner::Error& e) {
+        DBG("bank index: " << e.what());
+        return false;
+    }
+    return true;
+}
+
+bool BankIndex::read_cache(const juce::File& idx)
+{
+    juce::FileInputStream in(idx);
+    if (!in.openedOk() || in.readString() != cache_magic)
+        return false;
+    if (in.readInt64() != size || in.readInt64() != mtime)
+        return false;
+    int n = in.readInt();
+    if (n < 0)
+        return false;
+    entries.clear();
+    entries.reserve(size_t(n));
+    for (int i = 0; i < n; i++) {
+        Entry e;
+        e.name = in.readString().toStdString();
+        e.offset = in.readInt64();
+        e.length = in.readInt64();
+        if (in.isExhausted() && i + 1 < n)
+            return false;
+        if (e.offset < 0 || e.length <= 0 || e.offset + e.length > size)
+            return false;
+        entries.push_back(std::move(e));
+    }
+    return true;
+}
+
+// best effort, a bank directory that isn't writable just isn't cached
+void BankIndex::write_cache(const juce::File& idx) const
+{
+    juce::TemporaryFile tmp(idx);
+    {
+        juce::FileOutputStream out(tmp.getFile());
+        if (!out.openedOk())
+            return;
+        out.writeString(cache_magic);
+        out.writeInt64(size);
+        out.writeInt64(mtime);
+        out.writeInt(int(entries.size()));
+        for (auto& e : entries) {
+            out.writeString(juce::String(e.name));
+            out.writeInt64(e.offset);
+            out.writeInt64(e.length);
+        }
+        out.flush();
+        if (out.getStatus().failed())
+            return;
+    }
+    tmp.overwriteTargetFileWithTemporary();
+}
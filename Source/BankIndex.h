@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gx_system { class PresetFile; }
+
+//==============================================================================
+/*
+** Preset names of a bank file and where their bodies are, without
+** parsing the bodies.
+**
+** A bank (["gx_head_file_version", [..], "name", {..}, "name", {..}, ..])
+** is mapped and only its top level is tokenized by a JsonScanner, the
+** preset objects are skipped. The result is kept in memory and in
+** ".<bank>.idx" next to the bank, both keyed by size and modification
+** time of the bank, so the next start lists the names without opening
+** the bank at all.
+**
+** Message thread. forget() drops the index of a bank this process just
+** wrote, in case size and time didn't change.
+*/
+class BankIndex
+{
+public:
+    struct Entry
+    {
+        std::string name;
+        juce::int64 offset, length;     // of the preset object in the file
+    };
+
+    // null when the bank can't be read
+    static std::shared_ptr<const BankIndex> get(const juce::File& bank);
+    static void forget(const juce::File& bank);
+
+    // the preset names of pf in bank order, from the index when the bank
+    // file can be read, else from the PresetFile
+    static std::vector<std::string> get_preset_names(gx_system::PresetFile& pf);
+
+    // the entries of a bank (or a state) in memory, header_end is where
+    // the file header ends, false when it isn't one
+    static bool scan(const char *data, size_t size, std::vector<Entry>& entries, size_t *header_end = nullptr);
+
+    const std::vector<Entry>& get_entries() const { return entries; }
+    const Entry *find(const std::string& name) const;
+
+private:
+    BankIndex(juce::int64 size, juce::int64 mtime)
+        : size(size), mtime(mtime) {}
+    bool read_cache(const juce::File& idx);
+    void write_cache(const juce::File& idx) const;
+    static juce::File get_cache_file(const juce::File& bank);
+
+    juce::int64 size, mtime;
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "DisplayRefresh.h"
+#include <algorithm>
+
+static const juce::uint32 tick_ms = 1000 / DisplayRefresh::max_rate;
+// vblank counts as gone after missing this long, the timer ticks then
+static const juce::uint32 vblank_timeout_ms = 100;
+
+std::unique_ptr<DisplayRefresh>& DisplayRefresh::get_instance()
+{
+    static std::unique_ptr<DisplayRefresh> instance;
+    return instance;
+}
+
+DisplayRefresh::DisplayRefresh()
+    : vblank_owner(nullptr), last_tick(0), last_vblank(0), in_tick(false)
+{
+    startTimer(int(tick_ms));
+}
+
+DisplayRefresh::~DisplayRefresh()
+{
+    stopTimer();
+}
+
+void DisplayRefresh::add_task(const void *owner, int interval_ms, std::function<void()> run, juce::Component *shown)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    auto& d = get_instance();
+    if (!d)
+        d.reset(new DisplayRefresh);
+    d->tasks.push_back({ owner, shown, juce::uint32(interval_ms), juce::Time::getMillisecondCounter(), std::move(run) });
+}
+
+void DisplayRefresh::remove_tasks(const void *owner)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    auto& d = get_instance();
+    if (!d)
+        return;
+    for (auto& t : d->tasks) {
+        if (t.owner == owner) {
+            // dropped after the tick when it's running
+            if (d->vblank_owner == t.shown) {
+                d->vblank = juce::VBlankAttachment();
+                d->vblank_owner = nullptr;
+            }
+            t.owner = nullptr;
+            t.shown = nullptr;
+            t.run = nullptr;
+        }
+    }
+    if (!d->in_tick) {
+        d->drop_removed();
+        if (d->tasks.empty())
+            d.reset();
+    }
+}
+
+void DisplayRefresh::drop_removed()
+{
+    tasks.erase(std::remove_if(tasks.begin(), tasks.end(),
+        [](const Task& t) { return t.owner == nullptr; }), tasks.end());
+}
+
+void DisplayRefresh::timerCallback()
+{
+    juce::uint32 now = juce::Time::getMillisecondCounter();
+    if (now - last_vblank < vblank_timeout_ms)
+        return;
+    attach();
+    tick(now);
+}
+
+void DisplayRefresh::on_vblank()
+{
+    juce::uint32 now = juce::Time::getMillisecondCounter();
+    last_vblank = now;
+    // a 60Hz display has a vblank every 16.7ms, let ticks that are a bit
+    // early pass
+    if (now - last_tick + 4 >= tick_ms)
+        tick(now);
+}
+
+void DisplayRefresh::tick(juce::uint32 now)
+{
+    last_tick = now;
+    in_tick = true;
+    // tasks can be added while iterating, don't hold a reference
+    for (size_t i = 0; i < tasks.size(); i++) {
+        if (!tasks[i].owner || (tasks[i].shown && !tasks[i].shown->isShowing()))
+            continue;
+        // the nearest tick counts as due
+        if (tasks[i].interval > 0 && now - tasks[i].last + tick_ms / 2 < tasks[i].interval)
+            continue;
+        tasks[i].last = now;
+        // a task may remove itself
+        auto run = tasks[i].run;
+        run();
+    }
+    in_tick = false;
+    drop_removed();
+    if (tasks.empty()) {
+        // not from inside its own callback
+        juce::MessageManager::callAsync([] {
+            auto& d = get_instance();
+            if (d && d->tasks.empty())
+                d.reset();
+        });
+    }
+}
+
+// follows the first showing component, the vblank attachment moves along
+// with it when it changes the window
+void DisplayRefresh::attach()
+{
+    if (vblank_owner && vblank_owner->isShowing())
+        return;
+    for (auto& t : tasks) {
+        if (t.shown && t.shown->isShowing()) {
+            vblank_owner = t.shown;
+            vblank = juce::VBlankAttachment(vblank_owner, [this] { on_vblank(); });
+            return;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/*
+** One refresh tick for all periodic work of the process: meters and
+** tuners of every editor, the editors' and processors' own periodic
+** updates. Many plugin instances wake the message thread once per tick
+** instead of each with its own timers.
+**
+** A task runs in the first tick after its interval passed, 0 runs it in
+** every tick. A task shown with a component runs only while that
+** component is showing, so closed or hidden editors cost nothing. add()
+** is a task for animating components: every tick while showing, the
+** function decides itself if anything changed and what to repaint.
+**
+** The tick follows the vertical blank of the display one of the showing
+** components is on, limited to max_rate per second. A timer takes over
+** while no vblank arrives (no editor open, a host without vblank events).
+**
+** The driver exists while there are tasks. Message thread only.
+*/
+class DisplayRefresh : private juce::Timer
+{
+public:
+    static const int max_rate = 30;
+
+    static void add_task(const void *owner, int interval_ms, std::function<void()> run,
+                         juce::Component *shown = nullptr);
+    static void remove_tasks(const void *owner);
+
+    static void add(juce::Component *c, std::function<void()> refresh) { add_task(c, 0, std::move(refresh), c); }
+    static void remove(juce::Component *c) { remove_tasks(c); }
+
+    ~DisplayRefresh() override;
+
+private:
+    struct Task
+    {
+        const void *owner;
+        juce::Component *shown;
+        juce::uint32 interval, last;
+        std::function<void()> run;
+    };
+
+    DisplayRefresh();
+    static std::unique_ptr<DisplayRefresh>& get_instance();
+
+    void timerCallback() override;
+    void on_vblank();
+    void tick(juce::uint32 now);
+    void attach();
+    void drop_removed();
+
+    std::vector<Task> tasks;
+    juce::VBlankAttachment vblank;
+    juce::Component *vblank_owner;
+    juce::uint32 last_tick, last_vblank;
+    bool in_tick;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DisplayRefresh)
+};
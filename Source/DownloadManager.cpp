@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "DownloadManager.h"
+#include <algorithm>
+#include <curl/curl.h>
+
+static const char default_base_url[] = "https://musical-artifacts.com";
+static const size_t max_idle_handles = 4;
+
+struct DownloadManager::Transfer
+{
+    Request req;
+    CURL *easy = nullptr;
+    curl_slist *headers = nullptr;
+    std::unique_ptr<juce::TemporaryFile> tmp;
+    std::unique_ptr<juce::FileOutputStream> out;
+    std::string etag, last_modified;
+    juce::int64 received = 0, total = 0;
+    juce::uint32 last_report = 0;
+    std::weak_ptr<bool> alive;
+};
+
+static juce::File get_meta_file(const juce::File& target)
+{
+    return target.getSiblingFile("." + target.getFileName() + ".http");
+}
+
+// at most every 100ms, the message thread only needs it for display
+static void post_progress(DownloadManager::Transfer& t, bool force)
+{
+    if (!t.req.progress)
+        return;
+    juce::uint32 now = juce::Time::getMillisecondCounter();
+    if (!force && now - t.last_report < 100)
+        return;
+    t.last_report = now;
+    std::weak_ptr<bool> token = t.alive;
+    auto progress = t.req.progress;
+    juce::int64 received = t.received, total = t.total;
+    juce::MessageManager::callAsync([token, progress, received, total] {
+        if (token.lock())
+            progress(received, total);
+    });
+}
+
+static size_t write_cb(char *data, size_t size, size_t n, void *user)
+{
+    auto *t = static_cast<DownloadManager::Transfer*>(user);
+    if (!t->out->write(data, size * n))
+        return 0;   // aborts the transfer
+    return size * n;
+}
+
+static size_t header_cb(char *data, size_t size, size_t n, void *user)
+{
+    auto *t = static_cast<DownloadManager::Transfer*>(user);
+    juce::String line(juce::CharPointer_UTF8(data), size * n);
+    if (line.startsWith("HTTP/")) {
+        // status line of a new response (after a redirect)
+        t->etag.clear();
+        t->last_modified.clear();
+    } else if (line.startsWithIgnoreCase("etag:")) {
+        t->etag = line.fromFirstOccurrenceOf(":", false, false).trim().toStdString();
+    } else if (line.startsWithIgnoreCase("last-modified:")) {
+        t->last_modified = line.fromFirstOccurrenceOf(":", false, false).trim().toStdString();
+    }
+    return size * n;
+}
+
+static int progress_cb(void *user, curl_off_t dltotal, curl_off_t dlnow, curl_off_t, curl_off_t)
+{
+    auto *t = static_cast<DownloadManager::Transfer*>(user);
+    t->received = juce::int64(dlnow);
+    t->total = juce::int64(dltotal);
+    post_progress(*t, false);
+    return 0;
+}
+
+DownloadManager::DownloadManager()
+    : juce::Thread("download"), alive(std::make_shared<bool>(true)), multi(nullptr)
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+DownloadManager::~DownloadManager()
+{
+    alive.reset();
+    signalThreadShouldExit();
+    wakeup.signal();
+    stopThread(5000);
+    for (void *e : idle)
+        curl_easy_cleanup(e);
+    if (multi)
+        curl_multi_cleanup(multi);
+    curl_global_cleanup();
+}
+
+std::string DownloadManager::get_base_url()
+{
+    juce::String url = juce::SystemStats::getEnvironmentVariable("GUITARIX_ONLINE_URL", default_base_url);
+    return url.trimCharactersAtEnd("/").toStdString();
+}
+
+std::string DownloadManager::resolve(const std::string& url)
+{
+    if (url.find("://") != std::string::npos)
+        return url;
+    return get_base_url() + (url.empty() || url[0] != '/' ? "/" : "") + url;
+}
+
+void DownloadManager::fetch(Request req)
+{
+    req.url = resolve(req.url);
+    {
+        const juce::ScopedLock lock(cs);
+        busy.push_back(req.url);
+        queue.push_back(std::move(req));
+    }
+    if (!isThreadRunning())
+        startThread();
+    wakeup.signal();
+}
+
+bool DownloadManager::is_busy(const std::string& url) const
+{
+    const juce::ScopedLock lock(cs);
+    return std::find(busy.begin(), busy.end(), resolve(url)) != busy.end();
+}
+
+void DownloadManager::run()
+{
+    if (!multi)
+        multi = curl_multi_init();
+    while (!threadShouldExit()) {
+        for (;;) {
+            Request req;
+            {
+                const juce::ScopedLock lock(cs);
+                if (queue.empty())
+                    break;
+                req = std::move(queue.front());
+                queue.pop_front();
+            }
+            start(std::move(req));
+        }
+        if (transfers.empty()) {
+            wakeup.wait(500);
+            continue;
+        }
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        int left = 0;
+        while (CURLMsg *msg = curl_multi_info_read(multi, &left)) {
+            if (msg->msg == CURLMSG_DONE)
+                finish(msg->easy_handle, msg->data.result);
+        }
+        if (running > 0)
+            curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+    }
+    for (auto& t : transfers) {
+        curl_multi_remove_handle(multi, t->easy);
+        curl_easy_cleanup(t->easy);
+        curl_slist_free_all(t->headers);
+    }
+    transfers.clear();
+}
+
+void DownloadManager::start(Request req)
+{
+    std::unique_ptr<Transfer> t(new Transfer);
+    t->req = std::move(req);
+    t->alive = alive;
+    t->tmp.reset(new juce::TemporaryFile(t->req.target));
+    t->out.reset(new juce::FileOutputStream(t->tmp->getFile()));
+    if (!t->out->openedOk()) {
+        t->out.reset();
+        transfers.push_back(std::move(t));
+        finish(nullptr, CURLE_WRITE_ERROR);
+        return;
+    }
+    if (!idle.empty()) {
+        t->easy = idle.back();
+        idle.pop_back();
+    } else {
+        t->easy = curl_easy_init();
+    }
+    CURL *e = t->easy;
+    curl_easy_setopt(e, CURLOPT_URL, t->req.url.c_str());
+    curl_easy_setopt(e, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(e, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(e, CURLOPT_USERAGENT, "guitarix.vst");
+    curl_easy_setopt(e, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(e, CURLOPT_WRITEDATA, t.get());
+    curl_easy_setopt(e, CURLOPT_HEADERFUNCTION, header_cb);
+    curl_easy_setopt(e, CURLOPT_HEADERDATA, t.get());
+    curl_easy_setopt(e, CURLOPT_XFERINFOFUNCTION, progress_cb);
+    curl_easy_setopt(e, CURLOPT_XFERINFODATA, t.get());
+    curl_easy_setopt(e, CURLOPT_NOPROGRESS, 0L);
+    if (t->req.conditional && t->req.target.existsAsFile()) {
+        juce::StringArray meta;
+        get_meta_file(t->req.target).readLines(meta);
+        if (meta.size() > 0 && meta[0].isNotEmpty())
+            t->headers = curl_slist_append(t->headers, ("If-None-Match: " + meta[0]).toRawUTF8());
+        if (meta.size() > 1 && meta[1].isNotEmpty())
+            t->headers = curl_slist_append(t->headers, ("If-Modified-Since: " + meta[1]).toRawUTF8());
+        curl_easy_setopt(e, CURLOPT_HTTPHEADER, t->headers);
+    }
+    curl_multi_add_handle(multi, e);
+    transfers.push_back(std::move(t));
+}
+
+void DownloadManager::finish(void *easy, int code)
+{
+    auto it = std::find_if(transfers.begin(), transfers.end(),
+        [easy](const std::unique_ptr<Transfer>& t) { return t->easy == easy; });
+    if (it == transfers.end())
+        return;
+    std::unique_ptr<Transfer> t = std::move(*it);
+    transfers.erase(it);
+
+    Result result = failed;
+    if (easy) {
+        long status = 0;
+        char *ct = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+        curl_easy_getinfo(easy, CURLINFO_CONTENT_TYPE, &ct);
+        bool ok_type = ct && (strstr(ct, "application/json") || strstr(ct, "application/octet-stream"));
+        t->out.reset();
+        if (code != CURLE_OK) {
+            DBG("download " << t->req.url << ": " << curl_easy_strerror(CURLcode(code)));
+        } else if (status == 304) {
+            result = not_modified;
+        } else if (status == 200 && ok_type) {
+            if (t->tmp->overwriteTargetFileWithTemporary()) {
+                result = downloaded;
+                juce::File meta = get_meta_file(t->req.target);
+                if (!t->req.conditional || (t->etag.empty() && t->last_modified.empty()))
+                    meta.deleteFile();
+                else
+                    meta.replaceWithText(juce::String(t->etag) + "\n" + juce::String(t->last_modified) + "\n");
+            }
+        } else {
+            DBG("download " << t->req.url << ": status " << status << ", " << (ct ? ct : "no content type"));
+        }
+        post_progress(*t, true);
+        curl_multi_remove_handle(multi, easy);
+        curl_slist_free_all(t->headers);
+        if (idle.size() < max_idle_handles) {
+            curl_easy_reset(easy);
+            idle.push_back(easy);
+        } else {
+            curl_easy_cleanup(easy);
+        }
+    }
+    {
+        const juce::ScopedLock lock(cs);
+        auto b = std::find(busy.begin(), busy.end(), t->req.url);
+        if (b != busy.end())
+            busy.erase(b);
+    }
+    std::weak_ptr<bool> token = alive;
+    auto done = std::move(t->req.done);
+    if (done) {
+        juce::MessageManager::callAsync([token, done, result] {
+            if (token.lock())
+                done(result);
+        });
+    }
+}
+
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+//==============================================================================
+/*
+** Downloads files on its own thread.
+**
+** All transfers run on one curl multi handle, so they run side by side and
+** connections to the server are kept open between them; finished easy
+** handles are reset and used for the next transfer. A transfer is written
+** to a temporary file next to the target and renamed over it when the
+** server answered 200 with a JSON or binary content type, the target is
+** left alone otherwise.
+**
+** A conditional request sends the ETag and Last-Modified of the last
+** download of the target (kept in ".<target>.http" beside it), a 304
+** answer keeps the target and is reported as not_modified.
+**
+** progress(received, total) and done(result) are called on the message
+** thread, total is 0 when the server didn't say. The destructor aborts
+** running transfers, their callbacks aren't called any more.
+**
+** Relative urls are taken from get_base_url(), musical-artifacts.com
+** unless GUITARIX_ONLINE_URL is set (e.g. to a local http server for
+** testing).
+*/
+class DownloadManager : private juce::Thread
+{
+public:
+    enum Result { failed, downloaded, not_modified };
+
+    struct Request
+    {
+        std::string url;
+        juce::File target;
+        bool conditional = false;
+        std::function<void(juce::int64 received, juce::int64 total)> progress;
+        std::function<void(Result)> done;
+    };
+
+    DownloadManager();
+    ~DownloadManager() override;
+
+    void fetch(Request req);
+    // queued or running
+    bool is_busy(const std::string& url) const;
+
+    static std::string get_base_url();
+    static std::string resolve(const std::string& url);
+
+    struct Transfer;    // DownloadManager.cpp
+
+private:
+    void run() override;
+    void start(Request req);
+    void finish(void *easy, int code);
+
+    juce::CriticalSection cs;
+    std::deque<Request> queue;
+    std::vector<std::string> busy;
+    juce::WaitableEvent wakeup;
+    std::shared_ptr<bool> alive;
+
+    // worker thread only
+    void *multi;
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    std::vector<void*> idle;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DownloadManager)
+};
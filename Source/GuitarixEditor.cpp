@@ -23,6 +23,10 @@
 #include "gx_jack_wrapper.h"
 
 #include "JuceUiBuilder.h"
+#include "BankIndex.h"
+#include "DownloadManager.h"
+#include "DisplayRefresh.h"
+#include "UiDescription.h"
 
 #ifdef _WINDOWS
 	#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
@@ -44,7 +48,10 @@ GuitarixEditor::GuitarixEditor(GuitarixProcessor& p)
     topBox(),
     ml(),
     new_bank(""),
-    new_preset("")
+    new_preset(""),
+    olp_is_tag(false),
+    olp_page(0),
+    showUnitLoad(false)
 	//singleButton("SINGLE"), multiButton("DOUBLE"),
 	//mute1Button("MONO 1"), mute2Button("MONO 2"),
 {
@@ -153,8 +160,13 @@ GuitarixEditor::GuitarixEditor(GuitarixProcessor& p)
 	//addAndMakeVisible(ed_r);
 	topBox.addAndMakeVisible(ed_s);
     
-    startTimer(1, 42);
-    startTimer(2, 200);
+    DisplayRefresh::add_task(this, 42, [this] { timerCallback(1); }, this);
+    DisplayRefresh::add_task(this, 500, [this] { timerCallback(2); }, this);
+    DisplayRefresh::add(this, [this] {
+        auto rms=audioProcessor.getRMSValues();
+        for(int i=0; i<4; i++)
+            meters[i].setLevel(rms[i].getCurrentValue());
+    });
     /*ladspa::LadspaPluginList ml;
     std::vector<std::string>  old_not_found;
     machine->load_ladspalist(old_not_found, ml);
@@ -165,20 +177,15 @@ GuitarixEditor::GuitarixEditor(GuitarixProcessor& p)
 
 GuitarixEditor::~GuitarixEditor()
 {
-	stopTimer(1);
-    stopTimer(2);
+    DisplayRefresh::remove_tasks(this);
     audioProcessor.set_editor(0);
 }
 
 void GuitarixEditor::timerCallback(int id)
 {
     if (!audioProcessor.HasSampleRate()) return;
+    // cabinet/preamp/contrast IRs are rebuilt by the processor's IRUpdateService
     if (id == 1) {
-        auto rms=audioProcessor.getRMSValues();
-        for(int i=0; i<4; i++) {
-            meters[i].setLevel(rms[i].getCurrentValue());
-            meters[i].repaint();
-        }
         // monitor mono feedback controller
         for (auto i = ed.clist.begin(); i != ed.clist.end(); ++i) {
             std::string id = (*i);
@@ -197,29 +204,59 @@ void GuitarixEditor::timerCallback(int id)
                 }
             }  
         }
-    } else {
-        bool stereo=audioProcessor.GetStereoMode();
-        if (machine->get_parameter_value<bool>("cab.on_off")) {
-            jack->get_engine().cabinet.pl_check_update();
-            if (stereo) jack_r->get_engine().cabinet.pl_check_update();
-        }
-        if (machine->get_parameter_value<bool>("cab_st.on_off")) {
-            jack->get_engine().cabinet_st.pl_check_update();
-        }
-        if (machine->get_parameter_value<bool>("pre.on_off")) {
-            jack->get_engine().preamp.pl_check_update();
-            if (stereo) jack_r->get_engine().preamp.pl_check_update();
-        }
-        if (machine->get_parameter_value<bool>("pre_st.on_off")) {
-            jack->get_engine().preamp_st.pl_check_update();
-        }
-        if (machine->get_parameter_value<bool>("con.on_off")) {
-            jack->get_engine().contrast.pl_check_update();
-            if (stereo) jack_r->get_engine().contrast.pl_check_update();
+    } else if (id == 2) {
+        // CPU time per rack unit, shown in the unit headers
+        bool profile = audioProcessor.GetProfile();
+        if (profile)
+            audioProcessor.update_unit_timing();
+        if (profile || showUnitLoad) {
+            ed.update_unit_load();
+            ed_s.update_unit_load();
         }
+        showUnitLoad = profile;
     }
 }
 
+void HorizontalMeter::resized()
+{
+    float scale = juce::Component::getApproximateScaleFactorForComponent(this);
+    int w = juce::roundToInt(getWidth() * scale), h = juce::roundToInt(getHeight() * scale);
+    if (w <= 0 || h <= 0) {
+        background = juce::Image();
+        return;
+    }
+    background = juce::Image(juce::Image::ARGB, w, h, true);
+    juce::Graphics g(background);
+    g.setColour(juce::Colours::white.withBrightness(0.4f));
+    g.fillRoundedRectangle(background.getBounds().toFloat(), 4.f * scale);
+}
+
+void HorizontalMeter::paint(juce::Graphics& g)
+{
+    auto bounds = getLocalBounds().toFloat();
+    if (background.isValid())
+        g.drawImage(background, bounds);
+    if (barWidth > 0) {
+        g.setColour(juce::Colours::white.withBrightness(float(brightness) / brightness_steps));
+        g.fillRoundedRectangle(bounds.removeFromLeft(float(barWidth)), 4.f);
+    }
+}
+
+void HorizontalMeter::setLevel(float level)
+{
+    int w = juce::jlimit(0, getWidth(), juce::roundToInt(juce::jmap(level, -60.f, +6.f, 0.f, float(getWidth()))));
+    int b = juce::roundToInt(juce::jmap(juce::jlimit(-60.f, 0.f, level), -60.f, 0.f, 0.5f, 1.0f) * brightness_steps);
+    if (b != brightness) {
+        repaint();
+    } else if (w != barWidth) {
+        // the rounded end of the bar reaches 4px back
+        int x0 = std::min(w, barWidth) - 5, x1 = std::max(w, barWidth) + 1;
+        repaint(x0, 0, x1 - x0, getHeight());
+    }
+    barWidth = w;
+    brightness = b;
+}
+
 void GuitarixEditor::updateModeButtons()
 {
 	bool stereo=audioProcessor.GetStereoMode(), multi=audioProcessor.GetMultiMode();
@@ -282,50 +319,7 @@ void GuitarixEditor::buttonClicked(juce::Button * b)
         ed.addTunerEditor();
     }
     else if (b == &aboutButton)
-    {
-        char txt[]=
-        "Guitarix virtual guitar amplifier VST3 port for Linux\n"
-        "Version v"
-        GXV
-        "\n"
-        "Portions (C) 2024 Hermann Meyer\n"
-        "\n"
-        "Guitarix.vst virtual guitar amplifier port for Mac/PC\n"
-        "Portions (C) 2022 Maxim Alexanian\n"
-        "\n"
-        "VST is a trademark of Steinberg Media Technologies GmbH, registered in \n"
-        "Europe and other countries.\n"
-        "\n"
-        "Guitarix virtual guitar amplifier for Linux\n"
-        "Copyright (C) Hermann Meyer, James Warden, Andreas Degert, Pete Shorthose\n"
-        "\n"
-        "This program is free software: you can redistribute it and/or modify \n"
-        "it under the terms of the GNU General Public License as published by \n"
-        "the Free Software Foundation, either version 3 of the License, or \n"
-        "(at your option) any later version.\n"
-        "\n"
-        "This program is distributed in the hope that it will be useful, \n"
-        "but WITHOUT ANY WARRANTY; without even the implied warranty of \n"
-        "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the \n"
-        "GNU General Public License for more details.\n"
-        "\n"
-        "You should have received a copy of the GNU General Public License \n"
-        "along with this program.  If not, see <http://www.gnu.org/licenses/>.\n"
-        "\n"
-        "For the source code for the Mac/PC port see \n"
-        "<https://github.com/maximalexanian/guitarix-vst>\n"
-        "\n"
-        "For the source code for the Linux port see \n"
-        "<https://github.com/brummer10/guitarix.vst>\n"
-        "\n \n";
-
-        juce::AlertWindow alertWindow("About Guitarix.vst",
-            txt, AlertWindow::InfoIcon);
-        alertWindow.addButton("Ok", 0);
-        alertWindow.setUsingNativeTitleBar(true);
-            
-        alertWindow.runModalLoop();
-    }
+        on_about_menu();
     else if (b == &onlineButton) {
         on_online_preset();
     }
@@ -373,6 +367,142 @@ void GuitarixEditor::buttonClicked(juce::Button * b)
 	updateModeButtons();
 }
 
+void GuitarixEditor::on_about_menu()
+{
+    juce::PopupMenu menu;
+    menu.addItem(1, "About Guitarix.vst");
+    menu.addSeparator();
+    menu.addItem(2, "Run left and right chains in parallel", true, audioProcessor.GetParallelMode());
+    menu.addItem(3, "Skip idle rack units", true, audioProcessor.GetIdleSkip());
+    menu.addItem(4, "Show idle rack units...");
+    menu.addItem(5, "Show CPU time per rack unit", true, audioProcessor.GetProfile());
+    menu.addItem(6, "CPU time report...", audioProcessor.GetProfile());
+    menu.addItem(7, "Save telemetry trace...");
+    juce::PopupMenu os;
+    const char *factors[] = { "Off", "2x", "4x", "8x" };
+    for (int i = 0; i < 4; i++)
+        os.addItem(10 + i, factors[i], true, audioProcessor.GetOversampling() == i);
+    os.addSeparator();
+    const char *quality[] = { "Draft filter", "Normal filter", "High quality filter" };
+    for (int i = 0; i < 3; i++)
+        os.addItem(20 + i, quality[i], true, audioProcessor.GetOversamplingQuality() == i);
+    menu.addSubMenu("Oversampling", os);
+    menu.showMenuAsync (PopupMenu::Options()
+        .withTargetComponent(&aboutButton)
+        .withMaximumNumColumns(1),
+         ModalCallbackFunction::forComponent (aboutMenuCallback, this));
+}
+
+void GuitarixEditor::aboutMenuCallback(int i, GuitarixEditor* ge)
+{
+    if (!ge) return;
+    if (i == 1)
+        ge->show_about();
+    else if (i == 2)
+        ge->machine->set_parameter_value("engine.parallel_chains", !ge->audioProcessor.GetParallelMode());
+    else if (i == 3)
+        ge->machine->set_parameter_value("engine.idle_skip", !ge->audioProcessor.GetIdleSkip());
+    else if (i == 4)
+        ge->show_idle_units();
+    else if (i == 5)
+        ge->machine->set_parameter_value("engine.profile", !ge->audioProcessor.GetProfile());
+    else if (i == 6)
+        ge->show_unit_timing();
+    else if (i == 7)
+        ge->save_telemetry_trace();
+    else if (i >= 10 && i < 14)
+        ge->machine->set_parameter_value("engine.oversample", i - 10);
+    else if (i >= 20 && i < 23)
+        ge->machine->set_parameter_value("engine.oversample_quality", i - 20);
+}
+
+void GuitarixEditor::show_about()
+{
+    char txt[]=
+    "Guitarix virtual guitar amplifier VST3 port for Linux\n"
+    "Version v"
+    GXV
+    "\n"
+    "Portions (C) 2024 Hermann Meyer\n"
+    "\n"
+    "Guitarix.vst virtual guitar amplifier port for Mac/PC\n"
+    "Portions (C) 2022 Maxim Alexanian\n"
+    "\n"
+    "VST is a trademark of Steinberg Media Technologies GmbH, registered in \n"
+    "Europe and other countries.\n"
+    "\n"
+    "Guitarix virtual guitar amplifier for Linux\n"
+    "Copyright (C) Hermann Meyer, James Warden, Andreas Degert, Pete Shorthose\n"
+    "\n"
+    "This program is free software: you can redistribute it and/or modify \n"
+    "it under the terms of the GNU General Public License as published by \n"
+    "the Free Software Foundation, either version 3 of the License, or \n"
+    "(at your option) any later version.\n"
+    "\n"
+    "This program is distributed in the hope that it will be useful, \n"
+    "but WITHOUT ANY WARRANTY; without even the implied warranty of \n"
+    "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the \n"
+    "GNU General Public License for more details.\n"
+    "\n"
+    "You should have received a copy of the GNU General Public License \n"
+    "along with this program.  If not, see <http://www.gnu.org/licenses/>.\n"
+    "\n"
+    "For the source code for the Mac/PC port see \n"
+    "<https://github.com/maximalexanian/guitarix-vst>\n"
+    "\n"
+    "For the source code for the Linux port see \n"
+    "<https://github.com/brummer10/guitarix.vst>\n"
+    "\n \n";
+
+    juce::AlertWindow alertWindow("About Guitarix.vst",
+        txt, AlertWindow::InfoIcon);
+    alertWindow.addButton("Ok", 0);
+    alertWindow.setUsingNativeTitleBar(true);
+        
+    alertWindow.runModalLoop();
+}
+
+void GuitarixEditor::show_idle_units()
+{
+    juce::AlertWindow alertWindow("Idle rack units",
+        audioProcessor.get_unit_monitor().get_report(), AlertWindow::InfoIcon);
+    alertWindow.addButton("Ok", 0);
+    alertWindow.setUsingNativeTitleBar(true);
+
+    alertWindow.runModalLoop();
+}
+
+void GuitarixEditor::show_unit_timing()
+{
+    juce::AlertWindow alertWindow("CPU time per rack unit",
+        audioProcessor.get_unit_monitor().get_timing_report(), AlertWindow::InfoIcon);
+    alertWindow.addButton("Ok", 0);
+    alertWindow.setUsingNativeTitleBar(true);
+
+    alertWindow.runModalLoop();
+}
+
+void GuitarixEditor::save_telemetry_trace()
+{
+    juce::File f = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+        .getChildFile("guitarix-trace-" + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + ".json");
+    auto fc = new juce::FileChooser ("Save telemetry trace...", f, "*.json", false);
+
+    fc->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+                     | juce::FileBrowserComponent::warnAboutOverwriting,
+                                            [this, fc] (const juce::FileChooser& chooser) {
+        juce::File result = chooser.getResult();
+        delete fc;
+        if (result == juce::File()) return;
+        Telemetry& t = audioProcessor.get_telemetry();
+        bool ok = t.write_trace(result);
+        juce::AlertWindow::showMessageBoxAsync(ok ? AlertWindow::InfoIcon : AlertWindow::WarningIcon,
+            "Telemetry trace",
+            ok ? t.get_summary() + "\n\nOpen " + result.getFullPathName() + " in chrome://tracing or ui.perfetto.dev."
+               : "Could not write " + result.getFullPathName());
+    });
+}
+
 void GuitarixEditor::loadLV2PlugCallback(int i, GuitarixEditor* ge)
 {
     if (!i) return;
@@ -419,10 +549,10 @@ void GuitarixEditor::load_preset_list()
             int in_factory = false;
             if (pp) {
                 PopupMenu sub;
-                for (auto p = pp->begin(); p != pp->end(); ++p) {
+                for (const std::string& name : BankIndex::get_preset_names(*pp)) {
                     int idx = bi * 1000 + (pi++) + 1;
-                    sub.addItem(idx, p->name.raw());
-                    if (b->get_name().raw() == bank && p->name.raw() == preset) {
+                    sub.addItem(idx, name);
+                    if (b->get_name().raw() == bank && name == preset) {
                         sel = idx;
                         new_bank = bank;
                         new_preset = preset;
@@ -475,8 +605,8 @@ void GuitarixEditor::on_preset_save()
                 }
             }
             if (pset.isNotEmpty() && bank.isNotEmpty()) {
+                // the preset list is reloaded when the bank is written
                 this->audioProcessor.save_preset(bank.toStdString(), pset.toStdString());
-                this->load_preset_list();
             }
         }
     });
@@ -498,13 +628,15 @@ void GuitarixEditor::on_preset_select()
         for (auto b = bb->begin(); b != bb->end(); ++b) {
             gx_system::PresetFile* pp = presets(b->get_name());
             int pi = 0;
-            if (pp)
-            for (auto p = pp->begin(); p != pp->end()+ad; ++p) {
-                int idx = bi * 1000 + (pi++) + 1;
-                if (idx == presetFileMenu.getSelectedId()) {
-                    new_bank = b->get_name().raw();
-                    if (ad == 0)
-                        new_preset = p->name.raw();
+            if (pp) {
+                std::vector<std::string> names = BankIndex::get_preset_names(*pp);
+                for (size_t i = 0; i < names.size() + ad; i++) {
+                    int idx = bi * 1000 + (pi++) + 1;
+                    if (idx == presetFileMenu.getSelectedId()) {
+                        new_bank = b->get_name().raw();
+                        if (ad == 0)
+                            new_preset = names[i];
+                    }
                 }
             }
         bi++;
@@ -515,118 +647,196 @@ void GuitarixEditor::on_preset_select()
 }
 
 void GuitarixEditor::read_online_preset_menu() {
-    ifstream is(audioProcessor.get_options()->get_online_config_filename());
-    olp.clear();
-    gx_system::JsonParser jp(&is);
-    try {
-	jp.next(gx_system::JsonParser::begin_array);
-	do {
-	    std::string NAME_;
-	    std::string FILE_;
-	    std::string INFO_;
-	    std::string AUTHOR_;
-	    jp.next(gx_system::JsonParser::begin_object);
-	    do {
-		jp.next(gx_system::JsonParser::value_key);
-		if (jp.current_value() == "name") {
-		    jp.read_kv("name", NAME_);
-		} else if (jp.current_value() == "description") {
-		    jp.read_kv("description", INFO_);
-		} else if (jp.current_value() == "author") {
-		    jp.read_kv("author", AUTHOR_);
-		} else if (jp.current_value() == "file") {
-		    jp.read_kv("file", FILE_);
-		} else {
-		    jp.skip_object();
-		}
-	    } while (jp.peek() == gx_system::JsonParser::value_key);
-	    jp.next(gx_system::JsonParser::end_object);
-	    INFO_ += "Author : " + AUTHOR_;
-	    olp.push_back(std::tuple<std::string,std::string,std::string>(NAME_,FILE_,INFO_));
-	} while (jp.peek() == gx_system::JsonParser::begin_object);
-    } catch (gx_system::JsonException& e) {
-	cerr << "JsonException: " << e.what() << ": '" << jp.current_value() << "'" << endl;
-	assert(false);
-    }
+    catalog.load(juce::File(audioProcessor.get_options()->get_online_config_filename()));
+    if (olp_filter.isEmpty())
+        olp_view = catalog.get_all();
+    else if (olp_is_tag)
+        olp_view = catalog.with_tag(olp_filter.toStdString());
+    else
+        olp_view = catalog.search(olp_filter);
 }
 
 void GuitarixEditor::downloadPreset(std::string uri) {
 
-    std::string::size_type n = uri.find_last_of('/');
-    if (n != std::string::npos) {
-        std::string fn = uri.substr(n);
-        std::string ff = "/tmp"+fn;
-
-        if (download_file(uri, ff)) {
-            machine->bank_insert_uri(Glib::filename_to_uri(ff, "localhost"), false, 0);
-            machine->bank_check_reparse();
-            load_preset_list();
-        }
+    std::string url = DownloadManager::resolve(uri);
+    std::string::size_type n = url.find_last_of('/');
+    if (n != std::string::npos && n + 1 < url.size()) {
+        juce::File ff = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile(url.substr(n + 1));
+        GuitarixProcessor *p = &audioProcessor;
+        juce::Component::SafePointer<GuitarixEditor> ge(this);
+        p->get_downloads().fetch({ url, ff, false,
+            [ge](juce::int64 received, juce::int64 total) {
+                if (ge) ge->show_download_progress(received, total);
+            },
+            [p, ge, ff](DownloadManager::Result r) {
+                if (ge) ge->end_download_progress();
+                // the bank is added when the editor was closed meanwhile
+                if (r == DownloadManager::downloaded)
+                    p->install_online_bank(ff);
+            } });
     }
 }
 
-void GuitarixEditor::handleOnlineMenu(int choice, GuitarixEditor* ge){
-    if (choice > 0) {
-        std::vector<std::tuple<std::string,std::string,std::string> >::iterator it = ge->olp.begin()+choice -1;
-        //fprintf(stderr, "%i %s \n",choice, get<1>(*it).c_str());
-        ge->downloadPreset(get<1>(*it));
-    }
+void GuitarixEditor::fetch_online_list(bool show_menu) {
+    juce::Component::SafePointer<GuitarixEditor> ge(this);
+    audioProcessor.get_downloads().fetch({ "artifacts.json?apps=guitarix",
+        juce::File(audioProcessor.get_options()->get_online_config_filename()), true,
+        [ge](juce::int64 received, juce::int64 total) {
+            if (ge) ge->show_download_progress(received, total);
+        },
+        [ge, show_menu](DownloadManager::Result r) {
+            if (!ge) return;
+            ge->end_download_progress();
+            if (r == DownloadManager::downloaded)
+                ge->read_online_preset_menu();
+            if (show_menu && !ge->catalog.empty())
+                ge->create_online_preset_menu();
+        } });
+}
+
+void GuitarixEditor::show_download_progress(juce::int64 received, juce::int64 total) {
+    if (total > 0)
+        onlineButton.setButtonText(juce::String(int(received * 100 / total)) + "%");
+    else
+        onlineButton.setButtonText("...");
+}
+
+void GuitarixEditor::end_download_progress() {
+    onlineButton.setButtonText("Online");
 }
 
 void GuitarixEditor::on_online_preset_select(int choice, GuitarixEditor* ge)
 {
-    if (choice > 0) {
-        std::vector<std::tuple<std::string,std::string,std::string> >::iterator it = ge->olp.begin()+choice -1;
-        juce::AlertWindow *w = new juce::AlertWindow("Download Online Preset", "", juce::AlertWindow::NoIcon);
-        juce::String m = get<2>(*it);
-        int a = m.indexOf("https");
-        int o = m.indexOf(a, "\n");
-        juce::HyperlinkButton* button = nullptr;
-        if (a>0 && o>0) {
-            juce::String n = m.substring(a,o);
-            juce::String message = m.substring(0, a-1);
-            juce::String message2 = m.substring(o+1);
-            w->setMessage(message);
-            if (n.isNotEmpty ()) {
-                button = new juce::HyperlinkButton(n, URL(n));
-                button->setBounds(0, 0, 400, 25);
-                button->setName("");
-                w->addCustomComponent(button);
-            }
-            w->addTextBlock(message2);
-            
-        } else {
-            w->setMessage(m);
+    if (choice <= 0)
+        return;
+    if (choice == online_search_item) {
+        ge->show_online_search();
+    } else if (choice == online_all_item) {
+        ge->olp_filter.clear();
+        ge->olp_is_tag = false;
+        ge->olp_view = ge->catalog.get_all();
+        ge->olp_page = 0;
+        ge->create_online_preset_menu();
+    } else if (choice == online_prev_item || choice == online_next_item) {
+        ge->olp_page += choice == online_next_item ? 1 : -1;
+        ge->create_online_preset_menu();
+    } else if (choice >= online_tag_items) {
+        size_t t = size_t(choice - online_tag_items);
+        if (t < ge->olp_tags.size()) {
+            ge->olp_filter = juce::String(ge->olp_tags[t]);
+            ge->olp_is_tag = true;
+            ge->olp_view = ge->catalog.with_tag(ge->olp_tags[t]);
+            ge->olp_page = 0;
+            ge->create_online_preset_menu();
         }
-        w->addButton("Download", 1, juce::KeyPress(juce::KeyPress::returnKey, 0, 0));
-        w->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey, 0, 0));
+    } else {
+        // the list may have been read again since the menu was shown
+        size_t i = size_t(ge->olp_page) * online_page_size + size_t(choice - 1);
+        if (i < ge->olp_view.size() && ge->olp_view[i] < ge->catalog.size())
+            ge->show_online_preset(ge->catalog.get(ge->olp_view[i]));
+    }
+}
 
-        auto checkPresets = ([&, w, button, choice, ge](int result) {
-            w->removeCustomComponent(w->getNumCustomComponents()-1);
-            if (button) delete button;
-            if (result == 1) {
-                handleOnlineMenu(choice, ge);
-            }
-        });
+void GuitarixEditor::show_online_preset(const OnlineCatalog::Entry& e)
+{
+    juce::AlertWindow *w = new juce::AlertWindow("Download Online Preset", "", juce::AlertWindow::NoIcon);
+    juce::String m = e.get_info();
+    int a = m.indexOf("https");
+    int o = m.indexOf(a, "\n");
+    juce::HyperlinkButton* button = nullptr;
+    if (a>0 && o>0) {
+        juce::String n = m.substring(a,o);
+        juce::String message = m.substring(0, a-1);
+        juce::String message2 = m.substring(o+1);
+        w->setMessage(message);
+        if (n.isNotEmpty ()) {
+            button = new juce::HyperlinkButton(n, URL(n));
+            button->setBounds(0, 0, 400, 25);
+            button->setName("");
+            w->addCustomComponent(button);
+        }
+        w->addTextBlock(message2);
 
-        auto callback = juce::ModalCallbackFunction::create(checkPresets);
-        w->enterModalState(true, callback, true);
+    } else {
+        w->setMessage(m);
     }
+    w->addButton("Download", 1, juce::KeyPress(juce::KeyPress::returnKey, 0, 0));
+    w->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey, 0, 0));
+
+    std::string file = e.file;
+    juce::Component::SafePointer<GuitarixEditor> ge(this);
+    auto checkPresets = ([w, button, file, ge](int result) {
+        w->removeCustomComponent(w->getNumCustomComponents()-1);
+        if (button) delete button;
+        if (result == 1 && ge) {
+            ge->downloadPreset(file);
+        }
+    });
+
+    auto callback = juce::ModalCallbackFunction::create(checkPresets);
+    w->enterModalState(true, callback, true);
 }
 
+void GuitarixEditor::show_online_search()
+{
+    juce::AlertWindow *w = new juce::AlertWindow("Search Online Presets", "Name, author or tag", juce::AlertWindow::NoIcon);
+    w->addTextEditor("query", olp_filter);
+    w->addButton("Search", 1, juce::KeyPress(juce::KeyPress::returnKey, 0, 0));
+    w->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey, 0, 0));
+
+    juce::Component::SafePointer<GuitarixEditor> ge(this);
+    auto search = ([w, ge](int result) {
+        if (result != 1 || !ge)
+            return;
+        ge->olp_filter = w->getTextEditorContents("query").trim();
+        ge->olp_is_tag = false;
+        ge->olp_view = ge->catalog.search(ge->olp_filter);
+        ge->olp_page = 0;
+        ge->create_online_preset_menu();
+    });
+
+    auto callback = juce::ModalCallbackFunction::create(search);
+    w->enterModalState(true, callback, true);
+}
+
+// one page of the current view, the catalog can hold thousands of presets
 void GuitarixEditor::create_online_preset_menu() {
 
-    static bool read_new = true;
-    if (read_new) {
+    if (catalog.empty())
         read_online_preset_menu();
-        read_new = false;
-    }
 
     juce::PopupMenu menu;
-    int i = 1;
-    for(std::vector<std::tuple<std::string,std::string,std::string> >::iterator it = olp.begin(); it != olp.end(); it++) {
-        menu.addItem(i, juce::String(get<0>(*it)));
-        i++;
+    menu.addItem(online_search_item, "Search...");
+    juce::PopupMenu tagMenu;
+    olp_tags.clear();
+    for (auto& t : catalog.get_tags(online_max_tags)) {
+        tagMenu.addItem(online_tag_items + int(olp_tags.size()), juce::String(t.first) + " (" + juce::String(t.second) + ")");
+        olp_tags.push_back(t.first);
+    }
+    menu.addSubMenu("Tags", tagMenu, !olp_tags.empty());
+    if (olp_filter.isNotEmpty())
+        menu.addItem(online_all_item, "Show all");
+
+    int pages = std::max(1, int((olp_view.size() + online_page_size - 1) / online_page_size));
+    olp_page = juce::jlimit(0, pages - 1, olp_page);
+    juce::String title = olp_filter.isEmpty() ? juce::String("All presets") : "\"" + olp_filter + "\"";
+    menu.addSectionHeader(title + ": " + juce::String(olp_view.size()) + ", page " + juce::String(olp_page + 1) + "/" + juce::String(pages));
+
+    DownloadManager& downloads = audioProcessor.get_downloads();
+    size_t first = size_t(olp_page) * online_page_size;
+    size_t last = std::min(olp_view.size(), first + online_page_size);
+    for (size_t i = first; i < last; i++) {
+        const OnlineCatalog::Entry& e = catalog.get(olp_view[i]);
+        int item = int(i - first) + 1;
+        if (downloads.is_busy(e.file))
+            menu.addItem(item, juce::String(e.name) + " (downloading)", false);
+        else
+            menu.addItem(item, juce::String(e.name));
+    }
+    if (olp_page > 0 || olp_page + 1 < pages) {
+        menu.addSeparator();
+        menu.addItem(online_prev_item, "< Previous page", olp_page > 0);
+        menu.addItem(online_next_item, "Next page >", olp_page + 1 < pages);
     }
 
     menu.showMenuAsync (PopupMenu::Options()
@@ -635,40 +845,6 @@ void GuitarixEditor::create_online_preset_menu() {
          ModalCallbackFunction::forComponent (on_online_preset_select, this));
 }
 
-bool GuitarixEditor::download_file(std::string from_uri, std::string to_path) {
-
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    CURL *curl = curl_easy_init();
-    CURLcode res;
-    FILE *out;
-    out = fopen(to_path.c_str(), "wb");
-
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, out);
-    curl_easy_setopt(curl, CURLOPT_URL, from_uri.c_str());
-    res = curl_easy_perform(curl);
-    if(CURLE_OK == res) {
-        char *ct = NULL;
-        res = curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &ct);
-        if (strstr(ct, "application/json")!= NULL ) {
-            res = CURLE_OK;
-        } else if (strstr(ct, "application/octet-stream")!= NULL) {
-            res = CURLE_OK;
-        } else {
-            res = CURLE_CONV_FAILED;
-        }
-    }
-    curl_easy_reset(curl);
-    fclose(out);
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    if(res != CURLE_OK) {
-        remove(to_path.c_str());
-        //gx_print_error( "download_file", Glib::ustring::compose("curl_easy_perform() failed: %1", curl_easy_strerror(res)));
-        return false;
-    }
-    return true;
-}
-
 void GuitarixEditor::on_online_preset()
 {
     static bool read_new = true;
@@ -680,10 +856,14 @@ void GuitarixEditor::on_online_preset()
         w->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey, 0, 0));
 
         auto checkPresets = ([&, w, this](int result) {
-            if (result == 1) {
-                download_file("https://musical-artifacts.com/artifacts.json?apps=guitarix", audioProcessor.get_options()->get_online_config_filename());
-            }
-            create_online_preset_menu();
+            // the last list is shown right away, a new one replaces it
+            // when it's there; without one the menu opens then
+            if (catalog.empty())
+                read_online_preset_menu();
+            if (result == 1)
+                fetch_online_list(catalog.empty());
+            if (!catalog.empty())
+                create_online_preset_menu();
         });
 
         auto callback = juce::ModalCallbackFunction::create(checkPresets);
@@ -754,10 +934,12 @@ MachineEditor::MachineEditor(GuitarixProcessor& p, bool right, MonoT mono) :
 	//	sigc::mem_fun(this, &MachineEditor::on_rack_unit_changed));
 
 	createPluginEditors();
+	DisplayRefresh::add_task(this, 1000, [this] { releaseCollapsedEditors(); }, this);
 }
 
 MachineEditor::~MachineEditor()
 {
+    DisplayRefresh::remove_tasks(this);
     //for (int i = cp.getNumPanels() - 1; i >= 0; i--)
     //    cp.removePanel(cp.getPanel(i));
     editors.clear();
@@ -770,6 +952,22 @@ bool MachineEditor::plugin_in_use(const char* id) {
     return true;
 }
 
+bool MachineEditor::get_unit_timing(const char *id, RackUnitMonitor::UnitTiming& t)
+{
+	if (!audioProcessor.GetProfile()) return false;
+	gx_engine::Plugin* pl = jack->get_engine().pluginlist.find_plugin(id);
+	return pl && audioProcessor.get_unit_monitor().get_timing(pl->get_pdef(), t);
+}
+
+void MachineEditor::update_unit_load()
+{
+	for (int i = 0; i < cp.getNumPanels(); i++)
+	{
+		PluginSelector *ps = ((PluginEditor*)cp.getPanel(i))->getPluginSelector();
+		if (ps) ps->repaint();
+	}
+}
+
 PluginDef* MachineEditor::get_pdef(const char *id)
 {
 	gx_engine::Plugin* p = jack->get_engine().pluginlist.lookup_plugin(id);
@@ -786,6 +984,11 @@ void MachineEditor::registerParListener(ParListener *ed)
 		editors.push_back(ed);
 }
 
+void MachineEditor::load_model(const std::string& id, const std::string& file, std::function<void()> done, bool both)
+{
+	audioProcessor.get_model_loader().request(machine, id, file, done, both);
+}
+
 void MachineEditor::unregisterParListener(ParListener *ed)
 {
 	auto f = std::find(editors.begin(), editors.end(), ed);
@@ -871,6 +1074,34 @@ void MachineEditor::addEditor(int idx, PluginSelector *ps, PluginEditor *pe, con
 	registerParListener(ps);
 }
 
+// a unit was built and turned out to have a different height than its
+// panel got, changed after the layout pass that built it
+void MachineEditor::setEditorHeight(PluginEditor *pe, int h)
+{
+	juce::Component::SafePointer<PluginEditor> p(pe);
+	juce::MessageManager::callAsync([this, p, h]
+	{
+		if (!p)
+			return;
+		int i = 0;
+		while (i < cp.getNumPanels() && cp.getPanel(i) != p.getComponent())
+			i++;
+		if (i == cp.getNumPanels())
+			return;
+		bool shown = p->getHeight() > 0;
+		cp.setMaximumPanelSize(p, h);
+		if (shown)
+			cp.expandPanelFully(p, false);
+	});
+}
+
+void MachineEditor::releaseCollapsedEditors()
+{
+	juce::uint32 now = juce::Time::getMillisecondCounter();
+	for (int i = 0; i < cp.getNumPanels(); i++)
+		((PluginEditor*)cp.getPanel(i))->release_if_collapsed(now);
+}
+
 void MachineEditor::addTunerEditor()
 {
     if (machine->get_parameter_value<bool>("system.show_tuner") ) {
@@ -937,7 +1168,7 @@ void MachineEditor::createPluginEditors()
 		registerParListener(&inputEditor);
 	}
 
-	int idx = 2;
+	std::vector<std::pair<PluginDef*, bool>> units;
 	for (int stereo = (mMono==mn_Stereo ? 1 : 0); stereo <= (mMono == mn_Mono ? 0 : 1); stereo++)
 	{
 		std::vector<std::string> ol;
@@ -953,18 +1184,32 @@ void MachineEditor::createPluginEditors()
 			{
 				if (*oli == (*a)->get_pdef()->id /*&& (*oli!="ampstack")*/)
 				{
-					const char* id = (*a)->get_pdef()->id;
-					const char* cat = (*a)->get_pdef()->category;
-					PluginSelector *ps = new PluginSelector(this, stereo, id, cat);
-					PluginEditor *pe = new PluginEditor(this, id, cat, ps);
-					addEditor(idx, ps, pe, (*a)->get_pdef()->name);
-					idx++;
+					units.push_back({ (*a)->get_pdef(), stereo != 0 });
 					break;
 				}
 			}
         }
 	}
 
+	// the panels that get shown right away build their widgets while
+	// they are added, the descriptions of the others are recorded on
+	// the pool meanwhile
+	std::vector<PluginDef*> pdefs;
+	for (auto& u : units)
+		pdefs.push_back(u.first);
+	UiDescription::prepare(machine, pdefs);
+
+	int idx = 2;
+	for (auto& u : units)
+	{
+		const char* id = u.first->id;
+		const char* cat = u.first->category;
+		PluginSelector *ps = new PluginSelector(this, u.second, id, cat);
+		PluginEditor *pe = new PluginEditor(this, id, cat, ps);
+		addEditor(idx, ps, pe, u.first->name);
+		idx++;
+	}
+
 	if (mMono == mn_Stereo && idx == 2)
 		addButtonClicked(0, true);
 
@@ -1281,9 +1526,64 @@ void MachineEditor::get_host_menu_for_parameter(juce::AudioProcessorParameter* p
                 juce::PopupMenu::Options{}.withTargetComponent(this).withMousePosition());
 }
 
+// host menu of the parameter followed by the MIDI CC items
 void MachineEditor::getParameterContext(const char* id) {
+    juce::PopupMenu menu;
     juce::RangedAudioParameter* param = audioProcessor.findParamForID(id);
-    if (param) get_host_menu_for_parameter(param);
+    if (param)
+        if (auto* c = audioProcessor.getEditor()->getHostContext())
+            if (auto menuInfo = c->getContextMenuForParameter (param))
+                menu = menuInfo->getEquivalentPopupMenu();
+    std::string pid(id);
+    if (audioProcessor.find_cc_param(pid)) {
+        if (menu.getNumItems()) menu.addSeparator();
+        add_midi_cc_items(menu, pid);
+    }
+    if (!menu.getNumItems()) return;
+    juce::Component::SafePointer<MachineEditor> self(this);
+    menu.showMenuAsync(juce::PopupMenu::Options{}.withTargetComponent(this).withMousePosition(),
+        [self, pid](int r) { if (self && r >= midi_cc_items) self->on_midi_cc_item(pid, r); });
+}
+
+void MachineEditor::add_midi_cc_items(juce::PopupMenu& menu, const std::string& id) {
+    MidiControllerMap& ccMap = audioProcessor.get_cc_map();
+    if (ccMap.is_learning(id))
+        menu.addItem(midi_cc_items + 1, "Cancel MIDI learn");
+    else
+        menu.addItem(midi_cc_items, "MIDI learn");
+    const MidiControllerMap::Mapping *m = ccMap.find(id);
+    if (!m) return;
+    juce::PopupMenu curves;
+    for (int c = 0; c < MidiControllerMap::num_curves; c++)
+        curves.addItem(midi_cc_items + 10 + c, MidiControllerMap::get_curve_name(c), true, m->curve == c);
+    curves.addSeparator();
+    curves.addItem(midi_cc_items + 20, "invert", true, m->invert);
+    menu.addSubMenu("MIDI CC " + juce::String(m->cc) + " curve", curves);
+    menu.addItem(midi_cc_items + 30, "Forget MIDI CC " + juce::String(m->cc));
+}
+
+void MachineEditor::on_midi_cc_item(const std::string& id, int r) {
+    MidiControllerMap& ccMap = audioProcessor.get_cc_map();
+    r -= midi_cc_items;
+    if (r == 0) {
+        ccMap.learn(id);
+        return;
+    } else if (r == 1) {
+        ccMap.cancel_learn();
+        return;
+    }
+    const MidiControllerMap::Mapping *old = ccMap.find(id);
+    if (!old) return;
+    MidiControllerMap::Mapping m = *old;
+    if (r >= 10 && r < 10 + MidiControllerMap::num_curves)
+        m.curve = r - 10;
+    else if (r == 20)
+        m.invert = !m.invert;
+    if (r == 30)
+        ccMap.remove(id);
+    else
+        ccMap.set(m);
+    audioProcessor.save_cc_map();
 }
 
 void MachineEditor::muteButtonContext(juce::ToggleButton *b, const char* id)
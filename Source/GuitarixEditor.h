@@ -23,7 +23,7 @@
 #include <glibmm.h>
 #include "PluginEditor.h"
 #include "guitarix.h"
-#include <curl/curl.h>
+#include "OnlineCatalog.h"
 
 namespace gx_jack { class GxJack; }
 namespace gx_engine { class GxMachine; class Parameter; class Plugin; class ParamMap;  }
@@ -42,6 +42,10 @@ public:
 
     void get_host_menu_for_parameter(juce::AudioProcessorParameter* param);
     void getParameterContext(const char* id);
+    void add_midi_cc_items(juce::PopupMenu& menu, const std::string& id);
+    void on_midi_cc_item(const std::string& id, int r);
+    // popup menu ids of the MIDI CC items, above the ids of host menus
+    static const int midi_cc_items = 0x4d430;
     //==============================================================================
 
 	void createPluginEditors();
@@ -49,8 +53,12 @@ public:
 
 	//PluginEditor callbacks =======================================================
 	void registerParListener(ParListener *ed);
+	void setEditorHeight(PluginEditor *pe, int h);
+	void load_model(const std::string& id, const std::string& file, std::function<void()> done, bool both);
 	void unregisterParListener(ParListener *ed);
 	PluginDef* get_pdef(const char *id);
+	bool get_unit_timing(const char *id, RackUnitMonitor::UnitTiming& t);
+	void update_unit_load();
 	gx_engine::ParamMap& get_param();
 	gx_engine::Parameter* get_parameter(const char* pid);
 	void list(const char* id, std::list<gx_engine::Parameter*> &pars);
@@ -97,6 +105,7 @@ private:
 	juce::ConcertinaPanel cp;
 
 	void addEditor(int idx, PluginSelector *ps, PluginEditor *pe, const char* name);
+	void releaseCollapsedEditors();
     bool tunerIsVisible;
 	std::list<ParListener*> editors;
 	PluginEditor inputEditor;
@@ -106,26 +115,21 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MachineEditor)
 };
 
+// the background is an image made in resized(), setLevel() only repaints
+// when the bar moves by a pixel or its brightness by a step, and then
+// only the part of the bar that changed when the brightness stayed
 class HorizontalMeter: public juce::Component
 {
 public:
-    void paint(juce::Graphics& g) override
-    {
-        auto bounds = getLocalBounds().toFloat();
-        
-        g.setColour(juce::Colours::white.withBrightness(0.4f));
-        g.fillRoundedRectangle(bounds, 4.f);
-        
-        const auto scaledX=juce::jmap(level,-60.f, +6.f, 0.f, bounds.getWidth());
-        const auto scaledCol=juce::jmap(level,-60.f, 0.f, 0.5f, 1.0f);
-        g.setColour(juce::Colours::white.withBrightness(scaledCol));
-        g.fillRoundedRectangle(bounds.removeFromLeft(scaledX), 4.f);
-    }
-    
-    void setLevel(float value) {level=value;}
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+    void setLevel(float value);
 
 private:
-    float level = -60.f;
+    static const int brightness_steps = 32;
+    juce::Image background;
+    int barWidth = 0;
+    int brightness = 0;
 };
 
 class PresetSelect: public juce::ComboBox
@@ -151,14 +155,16 @@ private:
 };
 
 //==============================================================================
-class GuitarixEditor : public juce::AudioProcessorEditor, public juce::Button::Listener, public juce::MultiTimer
+class GuitarixEditor : public juce::AudioProcessorEditor, public juce::Button::Listener
 {
 public:
 	GuitarixEditor(GuitarixProcessor&);
 	~GuitarixEditor() override;
     ladspa::LadspaPluginList ml;
 
-    void timerCallback(int id) override;
+    // DisplayRefresh tasks while the editor is showing: 1 every 42ms,
+    // 2 every 500ms
+    void timerCallback(int id);
     
     void paint(juce::Graphics&) override;
 	void resized() override;
@@ -196,15 +202,38 @@ private:
     void on_preset_select();
     void on_online_preset();
     static void loadLV2PlugCallback(int i, GuitarixEditor* ge);
+    void on_about_menu();
+    static void aboutMenuCallback(int i, GuitarixEditor* ge);
+    void show_about();
+    void show_idle_units();
+    void show_unit_timing();
+    void save_telemetry_trace();
     bool cat_match(std::string cat_in, std::vector<std::string> to_match);
     int get_category(std::string cat_in);
     void downloadPreset(std::string uri);
     void read_online_preset_menu();
-    static void handleOnlineMenu(int choice, GuitarixEditor* ge);
     static void on_online_preset_select(int choice, GuitarixEditor* ge);
+    void show_online_preset(const OnlineCatalog::Entry& e);
+    void show_online_search();
     void create_online_preset_menu();
-    bool download_file(std::string from_uri, std::string to_path);
-    std::vector< std::tuple<std::string,std::string,std::string> > olp;
+    void fetch_online_list(bool show_menu);
+    void show_download_progress(juce::int64 received, juce::int64 total);
+    void end_download_progress();
+    // the online menu shows a page of olp_view, all presets or those
+    // matching olp_filter (a search or a tag)
+    OnlineCatalog catalog;
+    std::vector<juce::uint32> olp_view;
+    juce::String olp_filter;
+    bool olp_is_tag;
+    int olp_page;
+    std::vector<std::string> olp_tags;
+    static const size_t online_page_size = 40;
+    static const size_t online_max_tags = 40;
+    enum {
+        online_search_item = 0x10000, online_all_item, online_prev_item, online_next_item,
+        online_tag_items = 0x20000
+    };
+    bool showUnitLoad;
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GuitarixEditor)
 };
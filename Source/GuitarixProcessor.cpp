@@ -20,6 +20,11 @@
 #include "gx_jack_wrapper.h"
 #include "guitarix.h"       // NOLINT
 #include "GuitarixEditor.h"
+#include "RtSafetyCheck.h"
+#include "JsonScanner.h"
+#include "BankIndex.h"
+#include "DisplayRefresh.h"
+#include "UiDescription.h"
 
 #ifdef _WINDOWS
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
@@ -92,6 +97,8 @@ void GuitarixStart::gx_save_preset(gx_engine::GxMachine* machine, const char* ba
 	Glib::ustring name(name_);
 	gx_system::PresetFileGui& cpf = *machine->get_bank_file(bank);
 	machine->pf_save(cpf, name);
+	if (gx_system::PresetFile *pf = machine->get_settings().banks.get_file(bank))
+		BankIndex::forget(juce::File(pf->get_filename()));
 }
 
 extern void gx_inited();
@@ -114,15 +121,35 @@ GuitarixProcessor::GuitarixProcessor()
 	, mMultiMode(false)
 	, mMono1Mute(false)
 	, mMono2Mute(false)
+	, mParallelMode(false)
+	, mIdleSkip(true)
+	, mProfile(false)
+	, mOversample(0)
+	, mOversampleQuality(Oversampler::normal)
     , buffersize(0)
 	, mLoading(false)
 	, mPresetsVisible(false)
 	, currentPreset(-1)
 	, pgm_chg()
 	, bank_chg()
+	, midiProgram(-1)
+	, midiBank(-1)
+	, numRamps(0)
+	, mSyncingAutomation(false)
+	, mNotifyingHost(false)
+	, lastBlockMs(0)
+	, headless(true)
+	, latencyPending(false)
+	, latencyPad(2, latency_pad_size)
+	, padPos(0)
+	, unitMonitorPending(false)
+	, ccStreamPos(0)
+	, ccProcessedPos(0)
 {
     out[0]=out[1]=0;
     SampleRate = 0;
+    latencyPad.clear();
+    padSamples[0] = padSamples[1] = 0;
     
 #ifdef _WINDOWS
 	static CHAR sModulePath[2048];
@@ -167,6 +194,9 @@ GuitarixProcessor::GuitarixProcessor()
 	jack_r->buffersize_callback(512);
 	jack_r->srate_callback((int)22050);
 
+	// the monitor wrappers around the units' code
+	update_unit_monitor();
+
 	par_stereo = new AudioParameterBool(juce::ParameterID("stereo",1), "Stereo In", false);
 	par_stereo->addListener(this);
 	addParameter(par_stereo);
@@ -179,14 +209,29 @@ GuitarixProcessor::GuitarixProcessor()
 		sigc::bind(sigc::mem_fun(*this, &GuitarixProcessor::on_param_insert_remove), false));
     mStereo.signal_changed().connect(
         sigc::mem_fun(this, &GuitarixProcessor::SetStereoMode));
+    pmap.reg_par(
+      "engine.parallel_chains", N_("run left and right chains in parallel"), &mParallelMode, false, false)->getBool().signal_changed().connect(
+        sigc::hide(sigc::mem_fun(this, &GuitarixProcessor::on_parallel_changed)));
+    pmap.reg_par(
+      "engine.idle_skip", N_("skip rack units that only process silence"), &mIdleSkip, true, false)->getBool().signal_changed().connect(
+        sigc::mem_fun(unitMonitor, &RackUnitMonitor::set_enabled));
+    pmap.reg_par(
+      "engine.profile", N_("measure the time each rack unit takes"), &mProfile, false, false)->getBool().signal_changed().connect(
+        sigc::mem_fun(unitMonitor, &RackUnitMonitor::set_profiling));
+    pmap.reg_par(
+      "engine.oversample", N_("oversampling of the amp and distortion units (1x, 2x, 4x, 8x)"), &mOversample, 0, 0, 3, true)->getInt().signal_changed().connect(
+        sigc::hide(sigc::mem_fun(this, &GuitarixProcessor::on_oversample_changed)));
+    pmap.reg_par(
+      "engine.oversample_quality", N_("oversampling filter quality"), &mOversampleQuality, int(Oversampler::normal), 0, 2, true)->getInt().signal_changed().connect(
+        sigc::hide(sigc::mem_fun(this, &GuitarixProcessor::on_oversample_changed)));
 	for (gx_engine::ParamMap::iterator i = pmap.begin(); i != pmap.end(); ++i) {
 		connect_value_changed_signal(i->second, false);
 	}
 	switch_bank = settings->get_current_bank();
 	settings->signal_rack_unit_order_changed().connect(
 		sigc::bind(sigc::mem_fun(*this, &GuitarixProcessor::on_rack_unit_changed), false));
-	pgm_chg.connect(sigc::mem_fun(this, &GuitarixProcessor::do_program_change));
-	bank_chg.connect(sigc::mem_fun(this, &GuitarixProcessor::do_bank_change));
+	pgm_chg.connect(sigc::mem_fun(this, &GuitarixProcessor::queue_program_change));
+	bank_chg.connect(sigc::mem_fun(this, &GuitarixProcessor::queue_bank_change));
 	/*
 	gx_preset::GxSettings *settings_r = &(machine_r->get_settings());
 	gx_engine::ParamMap& pmap_r = settings_r->get_param();
@@ -206,28 +251,217 @@ GuitarixProcessor::GuitarixProcessor()
     parameterMap.emplace(sel_preset->getParameterIndex(), sel_preset);
 
 	forwardParameters();
+	load_cc_map();
 	timer.set_machine(machine, machine_r);
+	timer.set_activity(&lastBlockMs);
     timer.newProgram.store(0, std::memory_order_release);
     timer.oldProgram.store(0, std::memory_order_release);
 	timer.program_chg.connect(sigc::mem_fun(this, &GuitarixProcessor::setCurrentProgram));
+	timer.param_sync.connect(sigc::mem_fun(this, &GuitarixProcessor::sync_automated_params));
+	timer.param_sync.connect(sigc::mem_fun(this, &GuitarixProcessor::check_midi_learn));
+	timer.param_sync.connect(sigc::mem_fun(this, &GuitarixProcessor::apply_midi_program_change));
+	for (auto *m : { machine, machine_r }) {
+		m->get_parameter("system.show_tuner").getBool().signal_changed().connect(
+			sigc::hide(sigc::mem_fun(*this, &GuitarixProcessor::update_tuner_use)));
+		m->get_parameter("ui.racktuner").getBool().signal_changed().connect(
+			sigc::hide(sigc::mem_fun(*this, &GuitarixProcessor::update_tuner_use)));
+	}
+	update_tuner_use();
+
+	timer.start();
+
+	irUpdate.set_engines(machine, jack, jack_r);
+	irUpdate.startThread();
+	modelLoader.startThread();
+}
+
+bool IRUpdateService::is_ir_parameter(const std::string& id)
+{
+	static const char *prefix[] = { "cab.", "cab_st.", "pre.", "pre_st.", "con." };
+	for (auto p : prefix) {
+		if (id.compare(0, strlen(p), p) == 0) return true;
+	}
+	return false;
+}
+
+void IRUpdateService::run()
+{
+	while (!threadShouldExit())
+	{
+		// parameter changes wake us up, the timeout only catches
+		// changes made behind our back (machine_r, engine reset)
+		wait(1000);
+		if (threadShouldExit()) break;
+		if (!active.load(std::memory_order_acquire)) continue;
+		const ScopedLock lock (update_cs);
+		check_update();
+	}
+}
+
+void IRUpdateService::set_engines(gx_engine::GxMachine *m, gx_jack::GxJack *j, gx_jack::GxJack *j_r)
+{
+	jack = j;
+	jack_r = j_r;
+	cab_on = &m->get_parameter("cab.on_off").getBool();
+	cab_st_on = &m->get_parameter("cab_st.on_off").getBool();
+	pre_on = &m->get_parameter("pre.on_off").getBool();
+	pre_st_on = &m->get_parameter("pre_st.on_off").getBool();
+	con_on = &m->get_parameter("con.on_off").getBool();
+}
+
+void IRUpdateService::check_update()
+{
+	gx_engine::GxEngine& engine = jack->get_engine();
+	gx_engine::GxEngine& engine_r = jack_r->get_engine();
+	const bool st = stereo.load(std::memory_order_acquire);
+	if (cab_on->get_value()) {
+		engine.cabinet.pl_check_update();
+		if (st) engine_r.cabinet.pl_check_update();
+	}
+	if (cab_st_on->get_value()) {
+		engine.cabinet_st.pl_check_update();
+	}
+	if (pre_on->get_value()) {
+		engine.preamp.pl_check_update();
+		if (st) engine_r.preamp.pl_check_update();
+	}
+	if (pre_st_on->get_value()) {
+		engine.preamp_st.pl_check_update();
+	}
+	if (con_on->get_value()) {
+		engine.contrast.pl_check_update();
+		if (st) engine_r.contrast.pl_check_update();
+	}
+}
+
+bool ModelLoadService::is_model_parameter(const std::string& id)
+{
+	return id == "nam.loadfile" || id == "rtneural.loadfile";
+}
+
+void ModelLoadService::request(gx_engine::GxMachine *m, const std::string& id, const std::string& file,
+                               std::function<void()> done, bool both)
+{
+	{
+	const ScopedLock lock (job_cs);
+	for (auto i = pending.begin(); i != pending.end(); ++i) {
+		if (i->machine == m && i->id == id) {
+			pending.erase(i);
+			break;
+		}
+	}
+	pending.push_back({ m, id, file, done, both });
+	}
+	notify();
+}
 
-	timer.startTimer(1,100);
-	timer.startTimer(2,1000);
+void ModelLoadService::cancel()
+{
+	const ScopedLock lock (job_cs);
+	pending.clear();
+}
+
+void ModelLoadService::run()
+{
+	while (!threadShouldExit())
+	{
+		wait(500);
+		for (;;)
+		{
+			if (threadShouldExit()) return;
+			Job job;
+			{
+			const ScopedLock lock (job_cs);
+			if (pending.empty()) break;
+			job = pending.front();
+			pending.erase(pending.begin());
+			}
+			load(job);
+		}
+	}
+}
+
+void ModelLoadService::load(const Job& job)
+{
+	gx_engine::Parameter& p = job.machine->get_parameter(job.id);
+	// the copy to the other machine comes back to us
+	if (p.getString().get_value().raw() == job.file) {
+		if (job.done) juce::MessageManager::callAsync(job.done);
+		return;
+	}
+	// a missing or cut off file must neither interrupt the sound nor
+	// replace the running model, the engine parses it anyway
+	if (!job.file.empty() && !is_model_file(juce::File(juce::String::fromUTF8(job.file.c_str())))) {
+		if (job.done) juce::MessageManager::callAsync(job.done);
+		return;
+	}
+	const ScopedLock lock (load_cs);
+	// the NAM and RTNeural units of the engine build the network in the
+	// parameter's change handler and replace their model in place, so the
+	// output stays muted while they parse and build it
+	job.machine->start_ramp_down();
+	job.machine->wait_ramp_down_finished();
+	p.set_blocked(true);
+	loading_both = job.both;
+	job.machine->set_parameter_value(job.id, job.file);
+	loading_both = false;
+	p.set_blocked(false);
+	job.machine->start_ramp_up();
+	if (job.done) juce::MessageManager::callAsync(job.done);
+}
+
+// NAM and RTNeural models are JSON objects: looks at both ends of the file
+// only, instead of parsing what the engine parses again
+bool ModelLoadService::is_model_file(const juce::File& f)
+{
+	juce::FileInputStream in(f);
+	if (!in.openedOk() || in.getTotalLength() < 2)
+		return false;
+	char c = 0;
+	while (!in.isExhausted() && juce::CharacterFunctions::isWhitespace(c = in.readByte())) {}
+	if (c != '{')
+		return false;
+	char tail[64];
+	juce::int64 n = juce::jmin((juce::int64) sizeof(tail), in.getTotalLength());
+	in.setPosition(in.getTotalLength() - n);
+	n = in.read(tail, (int) n);
+	while (n > 0 && juce::CharacterFunctions::isWhitespace(tail[n - 1])) n--;
+	return n > 0 && tail[n - 1] == '}';
+}
+
+void PluginUpdateTimer::start()
+{
+    DisplayRefresh::add_task(this, 100, [this] { timerCallback(1); });
+    DisplayRefresh::add_task(this, 1000, [this] { timerCallback(2); });
+}
+
+void PluginUpdateTimer::stop()
+{
+    DisplayRefresh::remove_tasks(this);
 }
 
 void PluginUpdateTimer::timerCallback(int id)
 {
     const ScopedLock lock (timer_cs);
     if (id == 1) {
-        if (machine)
-            machine->timerUpdate();
-        if (machine_r)
-            machine_r->timerUpdate();
+        // one more update after the last block, none while the host
+        // doesn't process
+        juce::uint32 blockMs = lastBlockMs ? lastBlockMs->load(std::memory_order_relaxed) : updatedBlockMs + 1;
+        // nothing shows the output values while headless
+        if (editor && (resync || blockMs != updatedBlockMs)) {
+            resync = false;
+            updatedBlockMs = blockMs;
+            if (machine)
+                machine->timerUpdate();
+            if (machine_r)
+                machine_r->timerUpdate();
+        }
         if (mUpdateMode)
         {
             mUpdateMode = false;
             if (editor) editor->updateModeButtons();
         }
+        param_sync();
     } else if (id == 2) {
         if(newProgram.load(std::memory_order_acquire) !=
                 oldProgram.load(std::memory_order_acquire)) {
@@ -252,9 +486,20 @@ GuitarixProcessor::~GuitarixProcessor()
 	
 	{
     const ScopedLock lock (timer.timer_cs);
-    timer.stopTimer(1);
-    timer.stopTimer(2);
+    timer.stop();
     }
+    irUpdate.stopThread(2000);
+    modelLoader.stopThread(2000);
+    // recordings of unit UIs may still use the plugin definitions of the
+    // engines, their descriptions aren't looked up any more
+    UiDescription::forget(machine);
+    UiDescription::forget(machine_r);
+    rackPool.stop();
+    unitMonitor.uninstall();
+    // GUITARIX_TRACE=file.json keeps the telemetry of a whole session
+    juce::String trace = juce::SystemStats::getEnvironmentVariable("GUITARIX_TRACE", {});
+    if (trace.isNotEmpty())
+        telemetry.write_trace(juce::File::getCurrentWorkingDirectory().getChildFile(trace));
     delete out[0]; out[0]=0;
     delete out[1]; out[1]=0;
     delete gx;
@@ -279,9 +524,11 @@ void GuitarixProcessor::compareParameters() {
                 newValue = float(p->getBool().get_value());
             }
             if (std::fabs(val - newValue) > 0.001) {
+                mNotifyingHost = true;
                 para->beginChangeGesture();
                 para->setValueNotifyingHost(newValue);
                 para->endChangeGesture();
+                mNotifyingHost = false;
             }
        }
     }
@@ -340,48 +587,290 @@ void GuitarixProcessor::forwardParameters() {
     //fprintf(stderr, "%i\n", a);
 }
 
+static void set_param_value(gx_engine::Parameter& p, float v)
+{
+    if (p.isFloat())
+        p.getFloat().set(v);
+    else if (p.isInt())
+        p.getInt().set(int(v));
+    else if (p.isBool())
+        p.getBool().set(v > 0.5f);
+}
+
 void GuitarixProcessor::parameterValueChanged(int parameterIndex, float newValue)
 {
     auto ii = parameterMap.find (parameterIndex);
     if (ii == parameterMap.end()) return; // parameter is not in list
     auto* parameter = ii->second;
-    if (parameter->getParameterID() == "stereo") mStereoMode = newValue > 0.5;
+    if (parameter->getParameterID() == "stereo") {
+        mStereoMode = newValue > 0.5;
+        irUpdate.set_stereo(mStereoMode);
+    }
     else if (parameter->getParameterID() == "byps") return; // not implemented
     else if (parameter->getParameterID() == "selPreset")
         timer.newProgram.store(int(newValue * presets.size()), std::memory_order_release);
+    // the echo of an engine value we forward to the host, the engine has
+    // it already and a queued copy would overwrite newer changes
+    else if (juce::MessageManager::existsAndIsCurrentThread() && mNotifyingHost) {}
     else {
         gx_preset::GxSettings *settings = &((right?machine:machine_r)->get_settings());
         gx_engine::ParamMap& param = settings->get_param();
         gx_engine::Parameter& p1 = param[parameter->getParameterID().toStdString()];
-        if (&p1) {
-            if (p1.isFloat())
-                p1.getFloat().set(p1.getLowerAsFloat() +(newValue * (p1.getUpperAsFloat() - p1.getLowerAsFloat())));
-            else if (p1.isInt())
-                p1.getInt().set(int(p1.getLowerAsFloat() +(newValue * (p1.getUpperAsFloat() - p1.getLowerAsFloat()))));
-            else if (p1.isBool())
-                p1.getBool().set(newValue > 0.5);
-            //on_param_value_changed(&p1, false);
+        if (&p1 && (p1.isFloat() || p1.isInt() || p1.isBool())) {
+            float v = p1.isBool() ? float(newValue > 0.5) :
+                p1.getLowerAsFloat() +(newValue * (p1.getUpperAsFloat() - p1.getLowerAsFloat()));
+            if (p1.isInt()) v = float(int(v));
+            // the audio thread takes it over at the next block, while the
+            // host doesn't call processBlock the value is set right here
+            if (juce::Time::getMillisecondCounter() - lastBlockMs.load(std::memory_order_relaxed) > 500 ||
+                    !paramEvents.push({ &p1, v, false }))
+                set_param_value(p1, v);
         }
     }
     timer.update_mode();
 }
 
+//==============================================================================
+// automation on the audio thread
+
+// writes the value only, like the engine's midi_set(): signal_changed
+// runs the UI and engine listeners, sync_automated_params() emits it on
+// the message thread
+static void write_param_value(gx_engine::Parameter& p, float v)
+{
+	if (p.isFloat())
+	{
+		gx_engine::FloatParameter& f = p.getFloat();
+		*f.value = jlimit(f.getLowerAsFloat(), f.getUpperAsFloat(), v);
+	}
+	else if (p.isInt())
+	{
+		gx_engine::IntParameter& i = p.getInt();
+		*i.value = jlimit(int(i.getLowerAsFloat()), int(i.getUpperAsFloat()), int(v));
+	}
+	else if (p.isBool())
+		*p.getBool().value = v > 0.5f;
+}
+
+void GuitarixProcessor::apply_param_events()
+{
+	ParamEventQueue::Event e;
+	int len = SampleRate * ramp_ms / 1000;
+	while (paramEvents.pop(e))
+	{
+		if (e.param->isFloat() && len > 0)
+		{
+			int i = 0;
+			while (i < numRamps && ramps[i].param != e.param) i++;
+			if (i < int(ramps.size()))
+			{
+				// a new value for a running ramp starts from where it is
+				ramps[i] = { e.param, e.param->getFloat().get_value(), e.value, 0, len };
+				if (i == numRamps) numRamps++;
+				continue;
+			}
+		}
+		write_param_value(*e.param, e.value);
+		automatedParams.push({ e.param, 0.0f, e.right });
+	}
+}
+
+// called before each quantum with its length in host samples
+void GuitarixProcessor::advance_param_ramps(int n)
+{
+	for (int i = 0; i < numRamps; )
+	{
+		ParamRamp& r = ramps[i];
+		r.pos = std::min(r.pos + n, r.len);
+		bool last = r.pos == r.len;
+		write_param_value(*r.param, last ? r.to : r.from + (r.to - r.from) * r.pos / r.len);
+		// the steps are not synced at all, only the final value
+		if (last)
+		{
+			automatedParams.push({ r.param, 0.0f, false });
+			ramps[i] = ramps[--numRamps];
+		}
+		else i++;
+	}
+}
+
+// message thread, emits the signals of the values the audio thread
+// wrote, without echoing them back to the host
+void GuitarixProcessor::sync_automated_params()
+{
+	ParamEventQueue::Event e;
+	mSyncingAutomation = true;
+	while (automatedParams.pop(e))
+		e.param->trigger_changed();
+	while (ccDeferred.pop(e))
+		set_param_value(*e.param, e.value);
+	mSyncingAutomation = false;
+}
+
+//==============================================================================
+// MIDI CC map
+
+// before each quantum with its length in host samples
+void GuitarixProcessor::apply_midi_cc(int n)
+{
+	MidiControllerMap::Event e;
+	while (ccMap.next_event(ccProcessedPos + n, e))
+	{
+		// they switch units or modules, which rebuilds the rack
+		if (e.deferred)
+		{
+			ccDeferred.push({ e.param, e.value, false });
+			continue;
+		}
+		write_param_value(*e.param, e.value);
+		automatedParams.push({ e.param, 0.0f, false });
+	}
+	ccProcessedPos += n;
+}
+
+// message thread, a learned CC becomes the controller of the parameter,
+// curve and invert of an older mapping are kept
+void GuitarixProcessor::check_midi_learn()
+{
+	std::string id;
+	int cc = ccMap.poll_learned(id);
+	if (cc < 0) return;
+	gx_engine::Parameter *p = find_cc_param(id);
+	if (!p) return;
+	const MidiControllerMap::Mapping *old = ccMap.find(id);
+	if (ccMap.set({ id, p, cc, old ? old->curve : int(MidiControllerMap::linear), old ? old->invert : false }))
+		save_cc_map();
+}
+
+gx_engine::Parameter* GuitarixProcessor::find_cc_param(const std::string& id)
+{
+	gx_engine::ParamMap& pmap = machine->get_settings().get_param();
+	return pmap.hasId(id) ? &pmap[id] : nullptr;
+}
+
+static PropertiesFile::Options cc_map_options()
+{
+	PropertiesFile::Options o;
+	o.applicationName = JucePlugin_Name;
+	o.commonToAllUsers = false;
+	o.osxLibrarySubFolder = "Preferences";
+	o.filenameSuffix = "xml";
+	return o;
+}
+
+void GuitarixProcessor::load_cc_map()
+{
+	PropertiesFile f(cc_map_options());
+	if (auto xml = f.getXmlValue("MidiCCMap"))
+		ccMap.from_xml(*xml, [this](const std::string& id) { return find_cc_param(id); });
+}
+
+void GuitarixProcessor::save_cc_map()
+{
+	PropertiesFile f(cc_map_options());
+	f.setValue("MidiCCMap", ccMap.to_xml().get());
+}
+
 void GuitarixProcessor::SetStereoMode(bool on)
 {
+	const Telemetry::TimedLock irLock (telemetry, irUpdate.update_cs, Telemetry::ir_lock);
 	mStereoMode = on;
+	irUpdate.set_stereo(on);
 	*par_stereo = on;
+	schedule_latency_update();
 }
 
 //==============================================================================
 
 void GuitarixProcessor::update_plugin_list(bool add)
 {
+    // LADSPA/LV2 units are defined again, with their UIs
+    UiDescription::forget(machine);
     machine->save_ladspalist(editor->ml);
     jack->get_engine().ladspaloader_update_plugins();
     if (add) {
+        UiDescription::forget(machine_r);
        machine_r->save_ladspalist(editor->ml);
         jack_r->get_engine().ladspaloader_update_plugins();
     }
+    update_unit_monitor();
+    // ladspaloader_update_plugins() has switched the engines to the new
+    // module lists before it freed the old definitions
+    unitMonitor.release_retired();
+}
+
+// module selectors copy the entries of the selected module into their own
+// PluginDef when the engine rebuilds its lists, also when they are
+// switched on
+static bool is_selector_parameter(const std::string& id)
+{
+	static const char *suffix[] = { ".select", ".on_off" };
+	for (auto s : suffix) {
+		size_t n = strlen(s);
+		if (id.size() > n && id.compare(id.size() - n, n, s) == 0) return true;
+	}
+	return id == "crybaby.autowah";
+}
+
+// after the engine's own handlers of the parameter, once for a preset
+void GuitarixProcessor::schedule_unit_monitor_update()
+{
+	if (unitMonitorPending.exchange(true)) return;
+	juce::MessageManager::callAsync([this]
+	{
+		unitMonitorPending = false;
+		update_unit_monitor();
+		update_latency();
+	});
+}
+
+// (re)wraps the units of both engines, also picks up LV2 plugins and
+// module selectors that switched to other code
+void GuitarixProcessor::update_unit_monitor()
+{
+	for (gx_jack::GxJack *j : { jack, jack_r }) {
+		gx_engine::GxEngine& engine = j->get_engine();
+		std::vector<PluginDef*> pdefs;
+		for (bool stereo : { false, true }) {
+			std::list<gx_engine::Plugin*> l;
+			engine.pluginlist.ordered_list(l, stereo, 0, 0);
+			for (gx_engine::Plugin *p : l)
+				pdefs.push_back(p->get_pdef());
+		}
+		if (unitMonitor.install(pdefs, j == jack ? "left" : "right"))
+			engine.set_rack_changed();
+	}
+}
+
+void GuitarixProcessor::update_unit_timing()
+{
+	unitMonitor.update_timing();
+}
+
+void GuitarixProcessor::set_editor(GuitarixEditor* ed)
+{
+	editor = ed;
+	timer.set_editor(ed);
+	if (ed && headless.load(std::memory_order_relaxed)) {
+		// the audio thread doesn't touch the levels while headless
+		for (auto &r: rms)
+			r.setCurrentAndTargetValue(-100.f);
+		headless.store(false, std::memory_order_release);
+	} else if (!ed) {
+		headless.store(true, std::memory_order_release);
+	}
+	update_tuner_use();
+	compareParameters();
+}
+
+// the pitch tracker runs only while a tuner can be seen
+void GuitarixProcessor::update_tuner_use()
+{
+	bool show = !headless.load(std::memory_order_relaxed);
+	for (auto *m : { machine, machine_r }) {
+		m->tuner_used_for_display(show && (m->get_parameter_value<bool>("system.show_tuner")
+		                                   || m->get_parameter_value<bool>("ui.racktuner")));
+	}
 }
 
 void GuitarixProcessor::on_param_insert_remove(gx_engine::Parameter *p, bool inserted, bool right)
@@ -389,17 +878,31 @@ void GuitarixProcessor::on_param_insert_remove(gx_engine::Parameter *p, bool ins
 	if (inserted) {
 		connect_value_changed_signal(p, right);
 	}
+	if (!right && ccMap.find(p->id()))
+		ccMap.set_param(p->id(), inserted ? p : nullptr);
+	// the audio thread can't write it any more, the queued values are
+	// handed out while it still exists
+	if (!inserted)
+		sync_automated_params();
 }
 
 void GuitarixProcessor::on_param_value_changed(gx_engine::Parameter *p, bool right)
 {
+	bool notify = !mSyncingAutomation;
 	bool multi = mMultiMode;
 	if (editor && editor->GetAlternateDouble() && mMultiMode) multi = false;
-	
+	if (modelLoader.is_loading_both() && mMultiMode) multi = false;
+
+	bool ir_changed = IRUpdateService::is_ir_parameter(p->id());
+	if (ir_changed) irUpdate.trigger();
+	if (is_selector_parameter(p->id())) schedule_unit_monitor_update();
+	else if (p->id().compare(0, 3, "ui.") == 0) schedule_latency_update();
 	if (mLoading) return;
+	// meter and tuner values, only an editor shows them
+	if (p->isOutput() && headless.load(std::memory_order_relaxed)) return;
 
 	juce::MessageManager::callAsync(
-		[this, p, right, multi]
+		[this, p, right, multi, ir_changed, notify]
 	{
 		if (multi) return;
 		gx_preset::GxSettings *settings = &((right?machine:machine_r)->get_settings());
@@ -407,6 +910,8 @@ void GuitarixProcessor::on_param_value_changed(gx_engine::Parameter *p, bool rig
 		gx_engine::Parameter& p1 = param[p->id()];
         juce::RangedAudioParameter* para = findParamForID(p->id().c_str());
         float newValue = 0.0f;
+		// the IR thread reads the convolver settings of both machines
+		if (ir_changed) irUpdate.update_cs.enter();
 		p1.set_blocked(true);
 		if (p1.isFloat()) {
             newValue = p->getFloat().get_value();
@@ -419,6 +924,7 @@ void GuitarixProcessor::on_param_value_changed(gx_engine::Parameter *p, bool rig
 			p1.getBool().set(p->getBool().get_value());
 			if (p->id().substr(0, 3) == "ui.")
 			{
+				const ScopedLock irLock (irUpdate.update_cs);
 				std::stringstream ss;
 				saveState(ss, right);
 				loadState(ss, !right);
@@ -426,8 +932,12 @@ void GuitarixProcessor::on_param_value_changed(gx_engine::Parameter *p, bool rig
 				//if (editor) editor->createPluginEditors(right, !right, false);
 			}
 		}
-		else if (p1.isString())
-			p1.getString().set(p->getString().get_value());
+		else if (p1.isString()) {
+			if (ModelLoadService::is_model_parameter(p->id()))
+				modelLoader.request(right ? machine : machine_r, p->id(), p->getString().get_value().raw());
+			else
+				p1.getString().set(p->getString().get_value());
+		}
 		else if (dynamic_cast<gx_engine::JConvParameter*>(&p1) != 0)
 		{
 			gx_engine::JConvParameter *pp = dynamic_cast<gx_engine::JConvParameter*>(p);
@@ -441,14 +951,21 @@ void GuitarixProcessor::on_param_value_changed(gx_engine::Parameter *p, bool rig
 			pp1->set(pp->get_value());
 		}
 		p1.set_blocked(false);
+		// the copy on the other machine needs a rebuild too
+		if (ir_changed) {
+			irUpdate.update_cs.exit();
+			irUpdate.trigger();
+		}
         // forward internal value changes to the host parameters
-        if (para) {
+        if (para && notify) {
+            mNotifyingHost = true;
             para->beginChangeGesture();
             if (p1.isBool()) para->setValueNotifyingHost(newValue);
             else if ((p1.isInt()) || (p1.isFloat()))
                 para->setValueNotifyingHost((newValue -
                     p1.getLowerAsFloat()) / (p1.getUpperAsFloat() - p1.getLowerAsFloat()));
             para->endChangeGesture();
+            mNotifyingHost = false;
         }
 	}
 	);
@@ -530,7 +1047,24 @@ void PresetIO::collectRackOrder(gx_engine::Parameter *p, gx_system::JsonParser &
 }
 */
 
+// the preset saver writes banks behind the engine's PresetFile: waits for
+// its jobs on the bank and has the engine reparse what changed, before
+// the message thread reads or writes the bank through the engine
+void GuitarixProcessor::sync_bank(const std::string& bank) {
+    gx_system::PresetFile *pf = machine->get_settings().banks.get_file(bank);
+    if (!pf) return;
+    juce::File f(pf->get_filename());
+    if (presetSaver.is_writing(f)) {
+        presetSaver.wait_for(f);
+        BankIndex::forget(f);
+    }
+    machine->bank_check_reparse();
+}
+
 void GuitarixProcessor::load_preset(std::string _bank, std::string _preset) {
+    sync_bank(_bank);
+    // the IR thread doesn't see a half loaded preset
+    const Telemetry::TimedLock irLock (telemetry, irUpdate.update_cs, Telemetry::ir_lock);
     bool stereo = mStereoMode;
     SetStereoMode(false);
     gx->gx_load_preset(machine, _bank.c_str(), _preset.c_str());
@@ -548,10 +1082,55 @@ void GuitarixProcessor::load_preset(std::string _bank, std::string _preset) {
         }
     }
     SetStereoMode(stereo);
+    irUpdate.trigger();
 }
 
+// the preset is taken from the engine here, the bank is written by the
+// preset saver thread
 void GuitarixProcessor::save_preset(std::string _bank, std::string _preset) {
-    gx->gx_save_preset(machine, _bank.c_str(), _preset.c_str());
+    gx_system::PresetFile *pf = machine->get_settings().banks.get_file(_bank);
+    if (!pf || pf->get_type() == gx_system::PresetFile::PRESET_FACTORY) {
+        gx->gx_save_preset(machine, _bank.c_str(), _preset.c_str());
+        if (editor)
+            editor->load_preset_list();
+        return;
+    }
+    std::ostringstream os;
+    saveState(os, false);
+    presetSaver.save({ juce::File(pf->get_filename()), _preset, os.str(),
+        [this, _bank, _preset](bool ok) { on_preset_saved(_bank, _preset, ok); } });
+}
+
+void GuitarixProcessor::on_preset_saved(const std::string& bank, const std::string& preset, bool ok) {
+    if (!ok) {
+        // the bank or the snapshot wasn't usable, the engine saves it,
+        // after the jobs queued for the bank since
+        sync_bank(bank);
+        gx->gx_save_preset(machine, bank.c_str(), preset.c_str());
+    } else if (gx_system::PresetFile *pf = machine->get_settings().banks.get_file(bank)) {
+        BankIndex::forget(juce::File(pf->get_filename()));
+        machine->bank_check_reparse();
+    }
+    if (editor)
+        editor->load_preset_list();
+}
+
+void GuitarixProcessor::install_online_bank(const juce::File& f) {
+    machine->bank_insert_uri(Glib::filename_to_uri(f.getFullPathName().toStdString(), "localhost"), false, 0);
+    machine->bank_check_reparse();
+    if (editor)
+        editor->load_preset_list();
+}
+
+// message thread, a bank change only selects the bank of the next
+// program change
+void GuitarixProcessor::apply_midi_program_change() {
+    int bank = midiBank.exchange(-1, std::memory_order_acq_rel);
+    if (bank >= 0)
+        do_bank_change(bank);
+    int pgm = midiProgram.exchange(-1, std::memory_order_acq_rel);
+    if (pgm >= 0)
+        do_program_change(pgm);
 }
 
 void GuitarixProcessor::do_program_change(int pgm) {
@@ -561,18 +1140,17 @@ void GuitarixProcessor::do_program_change(int pgm) {
         bank = switch_bank;
 	}
     bool in_preset = !bank.empty();
-    gx_system::PresetFile *f;
+    std::vector<std::string> names;
     if (in_preset) {
-        f = settings->banks.get_file(bank);
-        in_preset = pgm < f->size();
+        sync_bank(bank);
+        gx_system::PresetFile *f = settings->banks.get_file(bank);
+        if (f) names = BankIndex::get_preset_names(*f);
+        in_preset = pgm < int(names.size());
     }
     if (in_preset) {
-        juce::MessageManagerLock *mmLock;
-        mmLock = new juce::MessageManagerLock;
-        load_preset(bank, f->get_name(pgm));
+        load_preset(bank, names[pgm]);
 		if(editor)
 			editor->load_preset_list();
-        delete mmLock;
     }
 }
 
@@ -689,20 +1267,10 @@ float GuitarixProcessor::getProgramsIndexValue() {
         return 0.0;
 	}
 
-    int i = 0;
-	gx_system::PresetBanks* bb = &settings->banks;
-	if (bb)
-		for (auto b = bb->begin(); b != bb->end(); ++b)
-		{
-			gx_system::PresetFile* pp = settings->banks.get_file(b->get_name());
-			if (pp) {
-				for (auto p = pp->begin(); p != pp->end(); ++p) {
-					if (b->get_name().raw() == bank && p->name.raw() == preset)
-						return float(float(i)/ float(presets.size() - 1));
-                        i++;
-				}
-            }
-		}
+	// presets holds every preset of every bank since refreshPrograms()
+	for (size_t i = 0; i < presets.size(); i++)
+		if (presets[i].first == bank && presets[i].second == preset)
+			return float(float(i)/ float(presets.size() - 1));
     return 0.0;
 }
 
@@ -732,12 +1300,12 @@ void GuitarixProcessor::refreshPrograms()
 			
 			int pi = 0;
 			if (pp)
-				for (auto p = pp->begin(); p != pp->end(); ++p)
+				for (const std::string& name : BankIndex::get_preset_names(*pp))
 				{
 					int idx = bi * 1000 + (pi++) + 1;
-                    choices.add(p->name.raw());
-					presets.push_back(make_pair(b->get_name().raw(),p->name.raw()));
-					if (b->get_name().raw() == bank && p->name.raw() == preset)
+                    choices.add(name);
+					presets.push_back(make_pair(b->get_name().raw(),name));
+					if (b->get_name().raw() == bank && name == preset)
 						currentPreset = presets.size() - 1;//sel = idx;
 				}
 			bi++;
@@ -776,7 +1344,9 @@ void GuitarixProcessor::setCurrentProgram (int index)
 {
 	if (index < 0 || index >= presets.size()) return;
 
+    juce::int64 t = telemetry.now();
     load_preset(presets[index].first, presets[index].second);
+    telemetry.event(Telemetry::set_program, index, t, telemetry.now() - t);
 
 	if(editor) {
         editor->load_preset_list();
@@ -827,6 +1397,8 @@ void GuitarixProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
         wpos=0;
         rpos=0;
         ppos=0;
+        ccStreamPos=ccProcessedPos=0;
+        ccMap.reset_events();
         olen=((buffersize+quantum-1)/quantum+1)*quantum;
 		tdelay=0;
 
@@ -836,13 +1408,30 @@ void GuitarixProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
         out[1]=new float[olen];
     }
 
+	{
+	const Telemetry::TimedLock irLock (telemetry, irUpdate.update_cs, Telemetry::ir_lock);
+	configure_engines();
+	}
+  
+	gx_inited();
+	irUpdate.set_active(true);
+	//gx_load_preset(machine, "Scratchpad", "Putilin");
+}
+
+// sets both engines up for the host rate and quantum, the oversampled
+// units for factor times that, with the engines stopped or ramped down
+void GuitarixProcessor::configure_engines()
+{
+	unitMonitor.set_samplerate(SampleRate);
+	unitMonitor.set_oversampling(1 << jlimit(0, 3, mOversample), mOversampleQuality, quantum);
+
 	std::ostringstream os;
 	saveState(os, false);
 
 	jack->buffersize_callback(quantum);
-	jack->srate_callback((int)sampleRate);
+	jack->srate_callback(SampleRate);
 	jack_r->buffersize_callback(quantum);
-	jack_r->srate_callback((int)sampleRate);
+	jack_r->srate_callback(SampleRate);
 
 	//Restore state - workaround to override parameters reset during Dsp::init() on sample rate change
 	mLoading = true;
@@ -850,9 +1439,106 @@ void GuitarixProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 	loadState(is, false);
 	mLoading = false;
 	cloneSettingsToMachineR();
-  
-	gx_inited();
-	//gx_load_preset(machine, "Scratchpad", "Putilin");
+	update_latency();
+}
+
+// the reported latency is one resampler delay for each oversampled unit in
+// the rack of the longer chain, switched on or not, so toggling a pedal
+// doesn't change it. Each output is delayed by what its running units
+// don't add.
+void GuitarixProcessor::update_latency()
+{
+	int delay = unitMonitor.get_oversampling_latency();
+	// oversampled units in the rack and running, of the mono [0] and the
+	// stereo [1] chain of each engine
+	int rack[2][2] = {}, running[2][2] = {};
+	if (delay > 0)
+	{
+		gx_jack::GxJack *jacks[2] = { jack, jack_r };
+		for (int e = 0; e < 2; e++)
+		{
+			for (int s = 0; s < 2; s++)
+			{
+				std::list<gx_engine::Plugin*> l;
+				jacks[e]->get_engine().pluginlist.ordered_list(l, s != 0, 0, 0);
+				for (gx_engine::Plugin *p : l)
+				{
+					if (!RackUnitMonitor::is_nonlinear(p->get_pdef())) continue;
+					if (p->get_on_off()) running[e][s]++;
+					if (p->get_on_off() || p->get_box_visible()) rack[e][s]++;
+				}
+			}
+		}
+	}
+	// the right output goes through the right engine's mono chain in stereo
+	// and multi mode, the stereo chain is always the left engine's
+	int r = (mStereoMode || mMultiMode) ? 1 : 0;
+	int latency = jmin((jmax(rack[0][0], rack[r][0]) + rack[0][1]) * delay, latency_pad_size - 1);
+	padSamples[0] = jmax(0, latency - (running[0][0] + running[0][1]) * delay);
+	padSamples[1] = jmax(0, latency - (running[r][0] + running[0][1]) * delay);
+	setLatencySamples(latency);
+}
+
+// units added to or removed from the rack, after the engine's handlers
+void GuitarixProcessor::schedule_latency_update()
+{
+	if (latencyPending.exchange(true)) return;
+	juce::MessageManager::callAsync([this]
+	{
+		latencyPending = false;
+		update_latency();
+	});
+}
+
+void GuitarixProcessor::pad_output(float *out[2], int n)
+{
+	const int mask = latency_pad_size - 1;
+	for (int c = 0; c < 2; c++)
+	{
+		int d = padSamples[c].load(std::memory_order_relaxed);
+		float *ring = latencyPad.getWritePointer(c);
+		for (int i = 0; i < n; i++)
+		{
+			ring[(padPos + i) & mask] = out[c][i];
+			out[c][i] = ring[(padPos + i - d) & mask];
+		}
+	}
+	padPos = (padPos + n) & mask;
+}
+
+// the helper thread only exists while the parallel mode is on
+void GuitarixProcessor::on_parallel_changed()
+{
+	juce::MessageManager::callAsync([this]
+	{
+		if (mParallelMode) rackPool.start();
+		else rackPool.stop();
+	});
+}
+
+void GuitarixProcessor::on_oversample_changed()
+{
+	// presets and the menu change it from any thread
+	juce::MessageManager::callAsync([this] { update_oversampling(); });
+}
+
+void GuitarixProcessor::update_oversampling()
+{
+	if (!SampleRate) return;
+	int f = 1 << jlimit(0, 3, mOversample);
+	if (f == unitMonitor.get_oversampling_factor()
+	    && mOversampleQuality == unitMonitor.get_oversampling_quality())
+		return;
+	// the audio wrappers use the resamplers unlocked, so the units are
+	// set up again while the engines are silent, not while they are muted
+	machine->start_ramp_down();
+	machine_r->start_ramp_down();
+	machine->wait_ramp_down_finished();
+	machine_r->wait_ramp_down_finished();
+	unitMonitor.set_oversampling(f, mOversampleQuality, quantum);
+	update_latency();
+	machine->start_ramp_up();
+	machine_r->start_ramp_up();
 }
 
 void GuitarixProcessor::releaseResources()
@@ -905,10 +1591,16 @@ void GuitarixProcessor::process_midi(juce::MidiBuffer& midiMessages)
         midi_buffer[1] = message.getRawData()[1];
         midi_buffer[2] = message.getRawData()[2];
         if ((midi_buffer[0] & 0xf0) == 0xc0 ) { // program change on any midi channel
+            juce::int64 t = telemetry.now();
             pgm_chg(int(midi_buffer[1]));
+            telemetry.audio_event(Telemetry::program_change, midi_buffer[1], t, telemetry.now() - t);
         } else if ((midi_buffer[0] & 0xf0) == 0xb0 ) { // controller
             if ((midi_buffer[1]== 32 || midi_buffer[1]== 0) ) { // bank change (LSB/MSB) on any midi channel
+                juce::int64 t = telemetry.now();
                 bank_chg(int(midi_buffer[2]));
+                telemetry.audio_event(Telemetry::bank_change, midi_buffer[2], t, telemetry.now() - t);
+            } else { // mapped or learned CC on any midi channel
+                ccMap.add_event(midi_buffer[1], midi_buffer[2], ccStreamPos + metadata.samplePosition);
             }
         }
     }
@@ -916,11 +1608,17 @@ void GuitarixProcessor::process_midi(juce::MidiBuffer& midiMessages)
 
 void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+	const rt_check::Scope rtCheck;
 	gx_inited();
 	juce::ScopedNoDenormals noDenormals;
+	const juce::int64 blockStart = telemetry.now();
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     process_midi(midiMessages);
+    ccStreamPos += buffer.getNumSamples();
+    lastBlockMs.store(juce::Time::getMillisecondCounter(), std::memory_order_relaxed);
+    const bool metering = !headless.load(std::memory_order_acquire);
+    apply_param_events();
 
     // In case we have more outputs than inputs, this code clears any output
     // channels that didn't contain input data, (because these aren't
@@ -950,7 +1648,7 @@ void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mi
 		buf[0] = buffer.getWritePointer(0);
         buf[1] = buffer.getWritePointer(1);
 
-        {
+        if (metering) {
         for(auto &r: rms) r.skip(n);
 
         const auto l=Decibels::gainToDecibels(getRMSLevel(buf[0],n));
@@ -960,7 +1658,11 @@ void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mi
         }
         
         if(out[0]==0 || out[1]==0)
+        {
+            advance_param_ramps(n);
+            apply_midi_cc(n);
             process(buf, n);
+        }
         else
         {
             DBGRT("BUF len:"<<n<<" delay:"<<delay);
@@ -994,7 +1696,11 @@ void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mi
                 float *p[2];
                 p[0]=out[0]+ppos;
                 p[1]=out[1]+ppos;
+                juce::int64 t = telemetry.now();
+                advance_param_ramps(quantum);
+                apply_midi_cc(quantum);
                 process(p, quantum);
+                telemetry.audio_event(Telemetry::quantum, quantum, t, telemetry.now() - t);
                 ppos+=quantum;
                 DBGRT("    PPOS:"<<ppos<<" after processing "<<quantum<<" unprocessed:"<<(wpos>=ppos?wpos-ppos:olen-ppos+wpos));
                 if(ppos>=olen) ppos-=olen; //ppos=0;
@@ -1058,7 +1764,7 @@ void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mi
             }
             }
         }
-        {
+        if (metering) {
         const auto l=Decibels::gainToDecibels(getRMSLevel(buf[0],n));
         if(l<rms[2].getCurrentValue()) rms[2].setTargetValue(l); else rms[2].setCurrentAndTargetValue(l);
         const auto r=Decibels::gainToDecibels(getRMSLevel(buf[1],n));
@@ -1068,6 +1774,11 @@ void GuitarixProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mi
 		jack->finish_process();
 		jack_r->finish_process();
 	}
+	else
+		apply_midi_cc(buffer.getNumSamples());
+	if (SampleRate)
+		telemetry.audio_event(Telemetry::block, buffer.getNumSamples(), blockStart, telemetry.now() - blockStart,
+		                      juce::int64(buffer.getNumSamples()) * 1000000000 / SampleRate);
 }
 
 void GuitarixProcessor::process(float *out[2], int n)
@@ -1077,45 +1788,43 @@ void GuitarixProcessor::process(float *out[2], int n)
 		jack->process(n, out[0], out);
 		jack_r->process_ramp(n);
 	}
-    else if(!mStereoMode && mMultiMode)
+    else //if (mStereoMode || mMultiMode)
     {
-		if (mMono2Mute)
-		{
-			memset(out[1], 0, sizeof(float) * n);
-			jack_r->process_ramp_mono(n);
-		}
-        else
-            jack_r->process_mono(n, out[0], out[1]);
-		if (mMono1Mute)
+		// multi mode feeds both chains from the left input
+		if (!mStereoMode)
+			memcpy(out[1], out[0], sizeof(float) * n);
+		ChainArgs chains[2] = {
+			{ jack, out[0], n, mMono1Mute },
+			{ jack_r, out[1], n, mMono2Mute } };
+		// the mono chains of both engines are independent up to process_stereo
+		if (mParallelMode)
 		{
-			memset(out[0], 0, sizeof(float) * n);
-			jack->process_ramp_mono(n);
+			RackThreadPool::Task tasks[2] = {
+				{ &GuitarixProcessor::process_chain, &chains[0] },
+				{ &GuitarixProcessor::process_chain, &chains[1] } };
+			rackPool.run(tasks, 2);
 		}
-        else
-            jack->process_mono(n, out[0], out[0]);
-        jack->process_stereo(n, out, out);
-		jack_r->process_ramp_stereo(n);
-    }
-    else //if (mStereoMode)
-    {
-		if (mMono2Mute)
-		{
-			memset(out[1], 0, sizeof(float) * n);
-			jack_r->process_ramp_mono(n);
-		}
-        else
-            jack_r->process_mono(n, out[1], out[1]);
-        if (mMono1Mute)
+		else
 		{
-            memset(out[0], 0, sizeof(float)*n);
-			jack->process_ramp_mono(n);
+			process_chain(&chains[1]);
+			process_chain(&chains[0]);
 		}
-		else
-            jack->process_mono(n, out[0], out[0]);
         jack->process_stereo(n, out, out);
 		jack_r->process_ramp_stereo(n);
 	}
+	pad_output(out, n);
+}
 
+void GuitarixProcessor::process_chain(void *arg)
+{
+	ChainArgs *c = static_cast<ChainArgs*>(arg);
+	if (c->mute)
+	{
+		memset(c->buf, 0, sizeof(float) * c->n);
+		c->jack->process_ramp_mono(c->n);
+	}
+	else
+		c->jack->process_mono(c->n, c->buf, c->buf);
 }
 
 //==============================================================================
@@ -1148,6 +1857,7 @@ void GuitarixProcessor::cloneSettingsToMachineR()
 
 	std::istringstream is(os.str());
 	loadState(is, true);
+	irUpdate.trigger();
 
 	/*	gx_engine::ParamMap &p = machine->get_settings().get_param();
 		gx_engine::ParamMap &p_r = machine_r->get_settings().get_param();
@@ -1178,7 +1888,8 @@ void GuitarixProcessor::getStateInformation (juce::MemoryBlock& destData)
 	saveState(os, false);
 	//::OutputDebugString(os.str().c_str());
 
-	destData.append(os.str().c_str(), os.str().length());
+	const std::string s = os.str();
+	destData.append(s.data(), s.size());
 
 	//auto xml = juce::parseXML(os.str().c_str());
 	//copyXmlToBinary()
@@ -1213,17 +1924,24 @@ void GuitarixProcessor::setStateInformation (const void* data, int sizeInBytes)
 	else
 		currentFile = defaultPath.getParentDirectory().getChildFile("---").getFullPathName();
 		*/
-	std::istringstream is;
-	is.str(std::string((const char*)data + offset, sizeInBytes - offset));
+	// read straight from the host's chunk
+	MemoryStreamBuf sb((const char*)data + offset, size_t(sizeInBytes - offset));
+	std::istream is(&sb);
 
+	// the state brings its own models
+	modelLoader.cancel();
+	const Telemetry::TimedLock modelLock (telemetry, modelLoader.load_cs, Telemetry::model_lock);
 	machine->start_ramp_down();
 	machine_r->start_ramp_down();
 	machine->wait_ramp_down_finished();
 	machine_r->wait_ramp_down_finished();
+	{
+	const Telemetry::TimedLock irLock (telemetry, irUpdate.update_cs, Telemetry::ir_lock);
 	mLoading = true;
 	loadState(is, false);
 	mLoading = false;
 	cloneSettingsToMachineR();
+	}
 
 	machine->start_ramp_up();
 	machine_r->start_ramp_up();
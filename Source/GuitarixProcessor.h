@@ -20,8 +20,16 @@
 
 #include <JuceHeader.h>
 #include <sigc++/sigc++.h>
+#include "RackThreadPool.h"
+#include "Oversampler.h"
+#include "RackUnitMonitor.h"
+#include "Telemetry.h"
+#include "ParamEventQueue.h"
+#include "MidiControllerMap.h"
+#include "PresetSaver.h"
+#include "DownloadManager.h"
 namespace gx_jack { class GxJack; }
-namespace gx_engine { class GxMachine; class Parameter; }
+namespace gx_engine { class GxMachine; class Parameter; class BoolParameter; }
 namespace gx_system { class CmdlineOptions; }
 
 //==============================================================================
@@ -51,23 +59,93 @@ private:
     static gx_system::CmdlineOptions *options;
 };
 
-class PluginUpdateTimer : public juce::MultiTimer
+// periodic work of an instance, run from the process wide DisplayRefresh
+// tick: 1 every 100ms, 2 every second
+class PluginUpdateTimer
 {
 public:
-	PluginUpdateTimer() : machine(0), editor(0), mUpdateMode(false), program_chg() {}
+	PluginUpdateTimer() : machine(0), editor(0), mUpdateMode(false), resync(false), lastBlockMs(0), updatedBlockMs(0), program_chg() {}
 	void set_machine(gx_engine::GxMachine *m, gx_engine::GxMachine *m_r) { machine = m; machine_r = m_r; }
-	void set_editor(GuitarixEditor* ed) { editor = ed; }
+	// without an editor output values aren't updated, the first update
+	// with one follows right away
+	void set_editor(GuitarixEditor* ed) { editor = ed; resync = true; }
+	// time of the last processed block, engines that didn't run since the
+	// last update have no new output values
+	void set_activity(const std::atomic<juce::uint32> *ms) { lastBlockMs = ms; }
 	void update_mode() { mUpdateMode = true; }
-	void timerCallback(int id) override;
+	void start();
+	void stop();
+	void timerCallback(int id);
     juce::CriticalSection timer_cs;
     std::atomic<int> newProgram;
     std::atomic<int> oldProgram;
     sigc::signal<void,int> program_chg;
+    sigc::signal<void> param_sync;
 
 private:
 	gx_engine::GxMachine *machine, *machine_r;
 	GuitarixEditor* editor;
 	bool mUpdateMode;
+	bool resync;
+	const std::atomic<juce::uint32> *lastBlockMs;
+	juce::uint32 updatedBlockMs;
+};
+
+// rebuilds cabinet, preamp and contrast IRs off the message thread
+class IRUpdateService : public juce::Thread
+{
+public:
+	IRUpdateService() : juce::Thread("guitarix IR update"), jack(0), jack_r(0), stereo(false), active(false) {}
+	void set_engines(gx_engine::GxMachine *m, gx_jack::GxJack *j, gx_jack::GxJack *j_r);
+	// engines are configured (sample rate known)
+	void set_active(bool on) { active.store(on, std::memory_order_release); notify(); }
+	// the right engine runs its own convolvers in stereo mode
+	void set_stereo(bool on) { stereo.store(on, std::memory_order_release); notify(); }
+	void trigger() { notify(); }
+	void run() override;
+	static bool is_ir_parameter(const std::string& id);
+	juce::CriticalSection update_cs;
+
+private:
+	void check_update();
+	gx_jack::GxJack *jack, *jack_r;
+	std::atomic<bool> stereo;
+	gx_engine::BoolParameter *cab_on, *cab_st_on, *pre_on, *pre_st_on, *con_on;
+	std::atomic<bool> active;
+};
+
+// loads NAM and RTNeural models off the message thread
+class ModelLoadService : public juce::Thread
+{
+public:
+	ModelLoadService() : juce::Thread("guitarix model loader"), loading_both(false) {}
+	// a newer request for the same parameter replaces a pending one,
+	// done is called on the message thread once the model is running,
+	// both loads it into the other machine too in multi mode (shift-click)
+	void request(gx_engine::GxMachine *m, const std::string& id, const std::string& file,
+	             std::function<void()> done = nullptr, bool both = false);
+	void cancel();
+	void run() override;
+	static bool is_model_parameter(const std::string& id);
+	// the parameter change handlers run on the loader thread, this tells
+	// them the model goes into both machines
+	bool is_loading_both() const { return isThisTheCurrentThread() && loading_both; }
+	// held while a model is swapped in
+	juce::CriticalSection load_cs;
+
+private:
+	struct Job
+	{
+		gx_engine::GxMachine *machine;
+		std::string id, file;
+		std::function<void()> done;
+		bool both;
+	};
+	void load(const Job& job);
+	static bool is_model_file(const juce::File& f);
+	juce::CriticalSection job_cs;
+	std::vector<Job> pending;
+	bool loading_both;
 };
 
 class GuitarixProcessor : public juce::AudioProcessor, private juce::AudioProcessorParameter::Listener
@@ -93,7 +171,9 @@ public:
 	juce::AudioProcessorEditor* getEditor() ;
 	bool hasEditor() const override;
 
-	void set_editor(GuitarixEditor* ed) { editor = ed; timer.set_editor(ed); compareParameters(); }
+	// set_editor(0) makes the engine headless: no meter levels, tuner
+	// analysis or output parameter updates until the next editor is set
+	void set_editor(GuitarixEditor* ed);
 	double scale;
 	//==============================================================================
 	const juce::String getName() const override;
@@ -118,9 +198,18 @@ public:
 
 	void SetStereoMode(bool on);
 	bool GetStereoMode() const { return mStereoMode; }
-	void SetMultiMode(bool on) { mMultiMode = on; }
+	void SetMultiMode(bool on) { mMultiMode = on; schedule_latency_update(); }
 	bool GetMultiMode() const { return mMultiMode; }
 	void SetMonoMute(bool m1, bool m2) { mMono1Mute = m1; mMono2Mute = m2; }
+	bool GetParallelMode() const { return mParallelMode; }
+	bool GetIdleSkip() const { return mIdleSkip; }
+	bool GetProfile() const { return mProfile; }
+	const RackUnitMonitor& get_unit_monitor() const { return unitMonitor; }
+	// message thread, takes a new timing window
+	void update_unit_timing();
+	Telemetry& get_telemetry() { return telemetry; }
+	int GetOversampling() const { return mOversample; }
+	int GetOversamplingQuality() const { return mOversampleQuality; }
 	void GetMonoMute(bool &m1, bool &m2) const { m1 = mMono1Mute; m2 = mMono2Mute; }
     bool HasSampleRate() { return SampleRate;}
 
@@ -133,12 +222,24 @@ public:
     const std::array<juce::LinearSmoothedValue<float>, 4>& getRMSValues() const {return rms;}
     void load_preset(std::string _bank, std::string _preset);
     void save_preset(std::string _bank, std::string _preset);
+    // online list and preset downloads, the bank of a downloaded preset
+    // is added with install_online_bank()
+    DownloadManager& get_downloads() { return downloads; }
+    void install_online_bank(const juce::File& f);
     void update_plugin_list(bool add);
     gx_system::CmdlineOptions *get_options() { return options; }
     juce::RangedAudioParameter* findParamForID(const char *id);
+    ModelLoadService& get_model_loader() { return modelLoader; }
+	// MIDI CC map, edited on the message thread, save_cc_map() after a change
+	MidiControllerMap& get_cc_map() { return ccMap; }
+	gx_engine::Parameter* find_cc_param(const std::string& id);
+	void save_cc_map();
 private:
 	bool mStereoMode, mMultiMode;
 	bool mMono1Mute, mMono2Mute;
+	bool mParallelMode;
+	bool mIdleSkip, mProfile;
+	int mOversample, mOversampleQuality;
 
 	GuitarixStart *gx;
 	gx_system::CmdlineOptions *options;
@@ -151,6 +252,12 @@ private:
 	void loadState(std::istream &is, bool right);
     void do_program_change(int pgm);
 	void do_bank_change(int pgm);
+	// MIDI program and bank changes, queued by the audio thread and done
+	// on the message thread
+	void queue_program_change(int pgm) { midiProgram.store(pgm, std::memory_order_release); }
+	void queue_bank_change(int bank) { midiBank.store(bank, std::memory_order_release); }
+	void apply_midi_program_change();
+	std::atomic<int> midiProgram, midiBank;
 	void cloneSettingsToMachineR();
 
 	void refreshPrograms();
@@ -172,8 +279,38 @@ private:
     int SampleRate;
     
     void process(float *out[2], int n);
+	void configure_engines();
+	void on_parallel_changed();
+	void on_oversample_changed();
+	void update_oversampling();
+	void update_latency();
+	void schedule_latency_update();
+	std::atomic<bool> latencyPending;
+	// delays the outputs up to the reported latency, the audio thread
+	// reads padSamples once per quantum
+	void pad_output(float *out[2], int n);
+	static const int latency_pad_size = 8192;
+	juce::AudioBuffer<float> latencyPad;
+	std::atomic<int> padSamples[2];
+	int padPos;
+	struct ChainArgs
+	{
+		gx_jack::GxJack *jack;
+		float *buf;
+		int n;
+		bool mute;
+	};
+	static void process_chain(void *arg);
+	RackThreadPool rackPool;
+	RackUnitMonitor unitMonitor;
+	void update_unit_monitor();
+	void schedule_unit_monitor_update();
+	std::atomic<bool> unitMonitorPending;
 
 	PluginUpdateTimer timer;
+	Telemetry telemetry;
+	IRUpdateService irUpdate;
+	ModelLoadService modelLoader;
 
 	juce::AudioParameterBool* par_stereo;
 	juce::AudioParameterChoice* sel_preset;
@@ -184,6 +321,46 @@ private:
 	void parameterValueChanged(int parameterIndex, float newValue) override;
 	void parameterGestureChanged(int, bool) override {}
 
+	// host automation is queued and applied by the audio thread between
+	// quanta, float parameters ramp to the new value over ramp_ms
+	static const int ramp_ms = 10;
+	struct ParamRamp
+	{
+		gx_engine::Parameter *param;
+		float from, to;
+		int pos, len;
+	};
+	ParamEventQueue paramEvents;
+	// parameters the audio thread set, synced on the message thread
+	ParamEventQueue automatedParams;
+	std::array<ParamRamp, 32> ramps;
+	int numRamps;
+	bool mSyncingAutomation;
+	// set on the message thread while engine values go to the host
+	bool mNotifyingHost;
+	std::atomic<juce::uint32> lastBlockMs;
+	std::atomic<bool> headless;
+	void update_tuner_use();
+	void apply_param_events();
+	void advance_param_ramps(int n);
+	void sync_automated_params();
+
+	// mapped MIDI CCs are queued with their position in the host stream
+	// (samples since the ring was set up) and applied before the quantum
+	// that holds that sample
+	MidiControllerMap ccMap;
+	juce::int64 ccStreamPos, ccProcessedPos;
+	// mapped switches, selectors and enums, set on the message thread
+	ParamEventQueue ccDeferred;
+	void apply_midi_cc(int n);
+	void check_midi_learn();
+	void load_cc_map();
+
+	PresetSaver presetSaver;
+	void sync_bank(const std::string& bank);
+	void on_preset_saved(const std::string& bank, const std::string& preset, bool ok);
+	DownloadManager downloads;
+
     float getProgramsIndexValue();
 	juce::String currentFile;
 	juce::File defaultPath;
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+** jsonbench: tokenizes .gx bank files (or any JSON) with
+**
+**   ifstream   gx_system::JsonParser on a std::ifstream, how banks,
+**              presets and the online list are read by the engine
+**   streambuf  gx_system::JsonParser on a MemoryStreamBuf over the
+**              mapped file, as setStateInformation() reads a chunk
+**   scanner    JsonScanner on the mapped file
+**
+**   jsonbench [-n runs] bank.gx ...
+**
+** Every number is converted, so the locale dependent istringstream in
+** JsonParser::current_value_float() is part of the time. Prints one JSON
+** object per file with the best time of the runs and the throughput.
+*/
+
+#include <JuceHeader.h>
+#include "JsonScanner.h"
+#include "guitarix.h"       // NOLINT
+#include <chrono>
+#include <fstream>
+
+struct WalkResult
+{
+    juce::int64 tokens = 0;
+    double sum = 0.0;   // keeps the conversions from being optimized away
+};
+
+static WalkResult walk(gx_system::JsonParser& jp)
+{
+    WalkResult r;
+    gx_system::JsonParser::token t;
+    while ((t = jp.next()) != gx_system::JsonParser::end_token) {
+        r.tokens++;
+        if (t == gx_system::JsonParser::value_number)
+            r.sum += jp.current_value_float();
+    }
+    return r;
+}
+
+static WalkResult walk(JsonScanner& jp)
+{
+    WalkResult r;
+    JsonScanner::token t;
+    while ((t = jp.next()) != JsonScanner::end_token) {
+        r.tokens++;
+        if (t == JsonScanner::value_number)
+            r.sum += jp.current_value_float();
+    }
+    return r;
+}
+
+// best of n runs in seconds
+static double best_of(int n, const std::function<WalkResult()>& f, WalkResult& r)
+{
+    double best = 1e30;
+    for (int i = 0; i < n; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        r = f();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = 5;
+    std::vector<juce::File> files;
+    for (int i = 1; i < argc; i++) {
+        juce::String a(argv[i]);
+        if (a == "-n" && i + 1 < argc) runs = std::max(1, atoi(argv[++i]));
+        else files.push_back(juce::File::getCurrentWorkingDirectory().getChildFile(a));
+    }
+    if (files.empty()) {
+        fprintf(stderr, "usage: %s [-n runs] bank.gx ...\n", argv[0]);
+        return 1;
+    }
+
+    for (auto& f : files) {
+        juce::MemoryMappedFile map(f, juce::MemoryMappedFile::readOnly);
+        if (!map.getData()) {
+            fprintf(stderr, "can't map %s\n", f.getFullPathName().toRawUTF8());
+            continue;
+        }
+        const char *data = static_cast<const char*>(map.getData());
+        size_t size = map.getSize();
+        std::string path = f.getFullPathName().toStdString();
+        WalkResult ri, rs, rj;
+        try {
+            double ti = best_of(runs, [&] {
+                std::ifstream is(path);
+                gx_system::JsonParser jp(&is);
+                return walk(jp);
+            }, ri);
+            double ts = best_of(runs, [&] {
+                MemoryStreamBuf sb(data, size);
+                std::istream is(&sb);
+                gx_system::JsonParser jp(&is);
+                return walk(jp);
+            }, rs);
+            double tj = best_of(runs, [&] {
+                JsonScanner jp(data, size);
+                return walk(jp);
+            }, rj);
+            double mb = size / 1e6;
+            juce::String line = "{\"file\": " + juce::JSON::toString(f.getFileName())
+                + ", \"bytes\": " + juce::String(juce::int64(size))
+                + ", \"tokens\": " + juce::String(rj.tokens)
+                + ", \"ifstream_ms\": " + juce::String(ti * 1e3, 3)
+                + ", \"streambuf_ms\": " + juce::String(ts * 1e3, 3)
+                + ", \"scanner_ms\": " + juce::String(tj * 1e3, 3)
+                + ", \"scanner_mb_per_s\": " + juce::String(mb / tj, 1)
+                + ", \"speedup\": " + juce::String(ti / tj, 2)
+                + ", \"same_tokens\": " + (ri.tokens == rj.tokens && rs.tokens == rj.tokens ? "true" : "false");
+            printf("%s}\n", line.toRawUTF8());
+        } catch (gx_system::JsonException& e) {
+            fprintf(stderr, "%s: %s\n", f.getFileName().toRawUTF8(), e.what());
+        } catch (JsonScanner::Error& e) {
+            fprintf(stderr, "%s: %s\n", f.getFileName().toRawUTF8(), e.what());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "JsonScanner.h"
+#include <charconv>
+#include <cstring>
+
+JsonScanner::JsonScanner(const char *data, size_t size)
+    : begin(data), end(data + size), pos(data)
+{
+    init();
+}
+
+JsonScanner::JsonScanner(const juce::File& file)
+    : begin(nullptr), end(nullptr), pos(nullptr)
+{
+    map.reset(new juce::MemoryMappedFile(file, juce::MemoryMappedFile::readOnly));
+    if (map->getData()) {
+        begin = pos = static_cast<const char*>(map->getData());
+        end = begin + map->getSize();
+    } else {
+        map.reset();
+    }
+    init();
+}
+
+void JsonScanner::init()
+{
+    cur_tok = next_tok = no_token;
+    next_decoded = 0;
+    depth = next_depth = 0;
+    cur_start = next_start = 0;
+    if (begin)
+        scan();
+    else
+        next_tok = end_token;
+}
+
+const char *JsonScanner::get_token_name(token tok)
+{
+    switch (tok) {
+    case no_token: return "no_token";
+    case end_token: return "end_token";
+    case begin_object: return "begin_object";
+    case end_object: return "end_object";
+    case begin_array: return "begin_array";
+    case end_array: return "end_array";
+    case value_string: return "value_string";
+    case value_number: return "value_number";
+    case value_key: return "value_key";
+    case value_null: return "value_null";
+    case value_false: return "value_false";
+    case value_true: return "value_true";
+    default: return "unknown token";
+    }
+}
+
+void JsonScanner::fail(const char *what, const char *at) const
+{
+    throw Error(what, size_t(at - begin));
+}
+
+void JsonScanner::check_expect(token expect) const
+{
+    if ((cur_tok & expect) == 0)
+        throw Error(std::string("expected ") + get_token_name(expect) + ", got " + get_token_name(cur_tok),
+                    get_offset());
+}
+
+JsonScanner::token JsonScanner::next(token expect)
+{
+    cur_tok = next_tok;
+    str = next_str;
+    depth = next_depth;
+    cur_start = next_start;
+    if (cur_tok != end_token)
+        scan();
+    if (expect != no_token)
+        check_expect(expect);
+    return cur_tok;
+}
+
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// reads the token after the current one into next_tok / next_str
+void JsonScanner::scan()
+{
+    while (pos < end && (is_space(*pos) || *pos == ','))
+        pos++;
+    next_start = size_t(pos - begin);
+    if (pos == end) {
+        next_tok = end_token;
+        next_str = {};
+        return;
+    }
+    const char *start = pos;
+    switch (*pos) {
+    case '{': pos++; next_tok = begin_object; next_depth++; break;
+    case '}': pos++; next_tok = end_object; next_depth--; break;
+    case '[': pos++; next_tok = begin_array; next_depth++; break;
+    case ']': pos++; next_tok = end_array; next_depth--; break;
+    case '"':
+        scan_string();
+        while (pos < end && is_space(*pos))
+            pos++;
+        if (pos < end && *pos == ':') {
+            pos++;
+            next_tok = value_key;
+        } else {
+            next_tok = value_string;
+        }
+        return;
+    case 'n':
+    case 't':
+    case 'f': {
+        static const struct { const char *word; size_t len; token tok; } words[] = {
+            { "null", 4, value_null }, { "true", 4, value_true }, { "false", 5, value_false } };
+        for (auto& w : words) {
+            if (size_t(end - pos) >= w.len && memcmp(pos, w.word, w.len) == 0) {
+                pos += w.len;
+                next_tok = w.tok;
+                next_str = std::string_view(start, w.len);
+                return;
+            }
+        }
+        fail("bad literal", start);
+    }
+    default:
+        if (*pos == '-' || (*pos >= '0' && *pos <= '9')) {
+            while (pos < end && (strchr("+-.eE", *pos) || (*pos >= '0' && *pos <= '9')))
+                pos++;
+            next_tok = value_number;
+            next_str = std::string_view(start, size_t(pos - start));
+            return;
+        }
+        fail("unexpected character", start);
+    }
+    next_str = std::string_view(start, 1);
+}
+
+static void append_utf8(std::string& s, juce::uint32 c)
+{
+    if (c < 0x80) {
+        s += char(c);
+    } else if (c < 0x800) {
+        s += char(0xc0 | (c >> 6));
+        s += char(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        s += char(0xe0 | (c >> 12));
+        s += char(0x80 | ((c >> 6) & 0x3f));
+        s += char(0x80 | (c & 0x3f));
+    } else {
+        s += char(0xf0 | (c >> 18));
+        s += char(0x80 | ((c >> 12) & 0x3f));
+        s += char(0x80 | ((c >> 6) & 0x3f));
+        s += char(0x80 | (c & 0x3f));
+    }
+}
+
+// pos is on the opening quote; without escapes the token is a view into
+// the buffer, else it is decoded into one of the two decoded strings
+void JsonScanner::scan_string()
+{
+    const char *start = ++pos;
+    while (pos < end && *pos != '"' && *pos != '\\')
+        pos++;
+    if (pos == end)
+        fail("unterminated string", start - 1);
+    if (*pos == '"') {
+        next_str = std::string_view(start, size_t(pos - start));
+        pos++;
+        return;
+    }
+    std::string& s = decoded[next_decoded];
+    next_decoded ^= 1;
+    s.assign(start, size_t(pos - start));
+    while (pos < end && *pos != '"') {
+        if (*pos != '\\') {
+            s += *pos++;
+            continue;
+        }
+        if (++pos == end)
+            break;
+        char c = *pos++;
+        switch (c) {
+        case 'b': s += '\b'; break;
+        case 'f': s += '\f'; break;
+        case 'n': s += '\n'; break;
+        case 'r': s += '\r'; break;
+        case 't': s += '\t'; break;
+        case 'u': {
+            auto hex4 = [this](juce::uint32& v) {
+                if (end - pos < 4)
+                    return false;
+                auto r = std::from_chars(pos, pos + 4, v, 16);
+                if (r.ptr != pos + 4)
+                    return false;
+                pos += 4;
+                return true;
+            };
+            juce::uint32 u;
+            if (!hex4(u))
+                fail("bad \\u escape", pos);
+            if (u >= 0xd800 && u < 0xdc00 && end - pos >= 6 && pos[0] == '\\' && pos[1] == 'u') {
+                pos += 2;
+                juce::uint32 lo;
+                if (!hex4(lo) || lo < 0xdc00 || lo >= 0xe000)
+                    fail("bad surrogate pair", pos);
+                u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            append_utf8(s, u);
+            break;
+        }
+        default: s += c; break;    // \" \\ \/
+        }
+    }
+    if (pos == end)
+        fail("unterminated string", start - 1);
+    pos++;
+    next_str = s;
+}
+
+//==============================================================================
+
+template <typename T>
+static T parse_number(std::string_view s)
+{
+    T v = 0;
+    std::from_chars(s.data(), s.data() + s.size(), v);
+    return v;
+}
+
+template <typename T>
+static T parse_float(std::string_view s)
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    return parse_number<T>(s);
+#else
+    // no floating point from_chars in this standard library
+    char buf[64];
+    size_t n = std::min(s.size(), sizeof(buf) - 1);
+    memcpy(buf, s.data(), n);
+    buf[n] = 0;
+    juce::CharPointer_ASCII p(buf);
+    return T(juce::CharacterFunctions::readDoubleValue(p));
+#endif
+}
+
+int JsonScanner::current_value_int() const
+{
+    return parse_number<int>(str);
+}
+
+unsigned int JsonScanner::current_value_uint() const
+{
+    return parse_number<unsigned int>(str);
+}
+
+float JsonScanner::current_value_float() const
+{
+    return parse_float<float>(str);
+}
+
+double JsonScanner::current_value_double() const
+{
+    return parse_float<double>(str);
+}
+
+bool JsonScanner::read_kv(const char *key, float& v)
+{
+    if (str != key)
+        return false;
+    next(value_number);
+    v = current_value_float();
+    return true;
+}
+
+bool JsonScanner::read_kv(const char *key, double& v)
+{
+    if (str != key)
+        return false;
+    next(value_number);
+    v = current_value_double();
+    return true;
+}
+
+bool JsonScanner::read_kv(const char *key, int& v)
+{
+    if (str != key)
+        return false;
+    next(value_number);
+    v = current_value_int();
+    return true;
+}
+
+bool JsonScanner::read_kv(const char *key, unsigned int& v)
+{
+    if (str != key)
+        return false;
+    next(value_number);
+    v = current_value_uint();
+    return true;
+}
+
+bool JsonScanner::read_kv(const char *key, std::string& v)
+{
+    if (str != key)
+        return false;
+    next(value_string);
+    v = current_value();
+    return true;
+}
+
+bool JsonScanner::read_kv(const char *key, std::string_view& v)
+{
+    if (str != key)
+        return false;
+    next(value_string);
+    v = current_value();
+    return true;
+}
+
+void JsonScanner::skip_object()
+{
+    int d = depth;
+    do {
+        if (next() == end_token)
+            fail("unexpected end of input", pos);
+    } while (depth != d);
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+//==============================================================================
+/*
+** JSON tokenizer over a buffer in memory or a memory mapped file.
+**
+** Same tokens and calling pattern as gx_system::JsonParser (next(),
+** peek(), current_value(), read_kv(), skip_object()), so reading code can
+** be moved over as it is, but the tokens are string_views into the buffer
+** instead of std::string copies, and numbers are converted with
+** std::from_chars, independent of the locale. A string with escapes is
+** decoded into the scanner, its view stays valid until the token after
+** the next one is read.
+**
+** Errors throw JsonScanner::Error with the offset in the buffer.
+*/
+class JsonScanner
+{
+public:
+    enum token {
+        no_token = 0x0000,
+        end_token = 0x0001,
+        begin_object = 0x0002,
+        end_object = 0x0004,
+        begin_array = 0x0008,
+        end_array = 0x0010,
+        value_string = 0x0020,
+        value_number = 0x0040,
+        value_key = 0x0080,
+        value_null = 0x0100,
+        value_false = 0x0200,
+        value_true = 0x0400,
+        value_bool = 0x0600,
+    };
+
+    struct Error : std::runtime_error
+    {
+        Error(const std::string& what, size_t pos)
+            : std::runtime_error(what + " at offset " + std::to_string(pos)), offset(pos) {}
+        size_t offset;
+    };
+
+    // the buffer must outlive the scanner
+    JsonScanner(const char *data, size_t size);
+    // maps the file, is_open() is false when that failed
+    explicit JsonScanner(const juce::File& file);
+
+    bool is_open() const { return begin != nullptr; }
+    size_t get_offset() const { return size_t(pos - begin); }
+    // where the current and the next token start in the buffer
+    size_t get_token_offset() const { return cur_start; }
+    size_t get_next_offset() const { return next_start; }
+    static const char *get_token_name(token tok);
+
+    token next(token expect = no_token);
+    token peek() const { return next_tok; }
+    void check_expect(token expect) const;
+
+    std::string_view current_value() const { return str; }
+    int current_value_int() const;
+    unsigned int current_value_uint() const;
+    float current_value_float() const;
+    double current_value_double() const;
+
+    bool read_kv(const char *key, float& v);
+    bool read_kv(const char *key, double& v);
+    bool read_kv(const char *key, int& v);
+    bool read_kv(const char *key, unsigned int& v);
+    bool read_kv(const char *key, std::string& v);
+    bool read_kv(const char *key, std::string_view& v);
+
+    // skips the value after the current token, a scalar or a whole
+    // object or array
+    void skip_object();
+
+private:
+    void init();
+    void scan();
+    void scan_string();
+    [[noreturn]] void fail(const char *what, const char *at) const;
+
+    std::unique_ptr<juce::MemoryMappedFile> map;
+    const char *begin, *end, *pos;
+    token cur_tok, next_tok;
+    std::string_view str, next_str;
+    std::string decoded[2];     // escaped strings of the current and the next token
+    int next_decoded;
+    int depth, next_depth;
+    size_t cur_start, next_start;
+
+    JUCE_DECLARE_NON_COPYABLE (JsonScanner)
+};
+
+//==============================================================================
+/*
+** Read-only std::streambuf over a buffer, for handing a host chunk or a
+** mapped file to std::istream readers (gx_system::JsonParser) without
+** copying it into a std::string first. Seeking is supported for tellg().
+*/
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const char *data, size_t size)
+    {
+        char *p = const_cast<char*>(data);
+        setg(p, p, p + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+        char *p = dir == std::ios_base::beg ? eback() : dir == std::ios_base::end ? egptr() : gptr();
+        p += off;
+        if (p < eback() || p > egptr())
+            return pos_type(off_type(-1));
+        setg(eback(), p, egptr());
+        return pos_type(p - eback());
+    }
+
+    pos_type seekpos(pos_type sp, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(sp), std::ios_base::beg, which);
+    }
+};
@@ -21,18 +21,8 @@
 
 using namespace juce;
 
-PluginEditor *JuceUiBuilder::ed = 0;
-int JuceUiBuilder::flags = 0;
-bool JuceUiBuilder::inHide(false);
-std::list<juce::FlexBox *> JuceUiBuilder::boxes;
-std::list<std::pair<JuceUiBuilder::boxkey_t, juce::Point<int> > > JuceUiBuilder::boxstack;
-std::list<juce::Component*> JuceUiBuilder::parents;
-juce::Rectangle<int> *JuceUiBuilder::bounds;
-juce::Slider *JuceUiBuilder::lastslider = 0;
-juce::ToggleButton *JuceUiBuilder::lastbutton = 0;
-juce::TextButton *JuceUiBuilder::lasttextbutton = 0;
-juce::ComboBox *JuceUiBuilder::lastcombo = 0;
-int edx, edy;
+// the builder the UiBuilder callbacks of this thread work on
+static thread_local JuceUiBuilder *current = 0;
 
 // icon to label wrapper
 const char* get_label(const char *sw_type) {
@@ -86,13 +76,11 @@ void AutoButton::mouseUp (const juce::MouseEvent& e)
 
 //==============================================================================
 JuceUiBuilder::JuceUiBuilder(PluginEditor *ed, PluginDef *pd, juce::Rectangle<int> *rect)
-	: UiBuilder() {
-	JuceUiBuilder::ed = ed;
+	: UiBuilder(), ed(ed), flags(0), inHide(false), bounds(rect),
+	  edx(rect->getX()), edy(rect->getY()), previous(current),
+	  lastslider(0), lastbutton(0), lasttextbutton(0), lastcombo(0) {
+	current = this;
 	plugin = pd;
-	flags = 0;
-	bounds = rect;
-	edx = bounds->getX();
-	edy = bounds->getY();
 
 	openTabBox = openTabBox_;
 	openVerticalBox = openVerticalBox_;
@@ -130,23 +118,18 @@ JuceUiBuilder::JuceUiBuilder(PluginEditor *ed, PluginDef *pd, juce::Rectangle<in
 	insertSpacer = insertSpacer_;
 	set_next_flags = set_next_flags_;
 
-	boxes.clear();
-	boxstack.clear();
-	parents.clear(); parents.push_front(ed);
+	parents.push_front(ed);
 
 	//addbox(true);
 }
 
 JuceUiBuilder::~JuceUiBuilder() {
 	//closebox();
-	ed = 0;
 	for (auto i = boxes.begin(); i != boxes.end(); ++i)
 	{	
 		delete *i;
 	}
-	boxes.clear();
-	boxstack.clear();
-	parents.clear();
+	current = previous;
 }
 /*
 #define UI_NUM_TOP           0x01
@@ -631,117 +614,117 @@ void JuceUiBuilder::openTabBox_(const char* label) {
 	juce::TabbedComponent* t = new juce::TabbedComponent(TabbedButtonBar::Orientation::TabsAtTop);
     t->getTabbedButtonBar().setColour (juce::TabbedButtonBar::ColourIds::frontTextColourId, juce::Colours::white);
     t->getTabbedButtonBar().setColour (juce::TabbedButtonBar::ColourIds::tabTextColourId, juce::Colour::fromRGBA(165, 165, 165, 255));
-	boxstack.push_front(decltype(boxstack)::value_type(boxkey_t(0, t), juce::Point<int>()));
+	current->boxstack.push_front(decltype(boxstack)::value_type(boxkey_t(0, t), juce::Point<int>()));
 }
 
 void JuceUiBuilder::openVerticalBox_(const char* label) {
-	addbox(true, label);
+	current->addbox(true, label);
 }
 
 void JuceUiBuilder::openVerticalBox1_(const char* label) {
-	addbox(true, label);
+	current->addbox(true, label);
 }
 
 void JuceUiBuilder::openVerticalBox2_(const char* label) {
-	addbox(false, label);
+	current->addbox(false, label);
 }
 
 void JuceUiBuilder::openHorizontalhideBox_(const char* label) {
-	inHide = true;
-	addbox(false, label);
+	current->inHide = true;
+	current->addbox(false, label);
 }
 
 void JuceUiBuilder::openHorizontalTableBox_(const char* label) {
-	addbox(false, label);
+	current->addbox(false, label);
 }
 
 void JuceUiBuilder::openFrameBox_(const char* label) {
-	addbox(false, label);
+	current->addbox(false, label);
 }
 
 void JuceUiBuilder::openFlipLabelBox_(const char* label) {
-	addbox(false, label);
+	current->addbox(false, label);
 }
 
 void JuceUiBuilder::openpaintampBox_(const char* label) {
-	addbox(false, label);
+	current->addbox(false, label);
 }
 
 void JuceUiBuilder::openHorizontalBox_(const char* label) {
-	addbox(false, label);
+	current->addbox(false, label);
 }
 
 void JuceUiBuilder::insertSpacer_() {
-	addspacer();
+	current->addspacer();
 }
 
 void JuceUiBuilder::set_next_flags_(int flags) {
-	JuceUiBuilder::flags = flags;
+	current->flags = flags;
 }
 
 void JuceUiBuilder::create_big_rackknob_(const char *id, const char *label) {
-	create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh + 40, knobh + 40);
+	current->create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh + 40, knobh + 40);
 }
 
 void JuceUiBuilder::create_mid_rackknob_(const char *id, const char *label) {
-	create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh + 20, knobh + 20);
+	current->create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh + 20, knobh + 20);
 }
 
 void JuceUiBuilder::create_small_rackknob_(const char *id, const char *label) {
-	create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh, knobh);
+	current->create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh, knobh);
 }
 
 void JuceUiBuilder::create_small_rackknobr_(const char *id, const char *label) {
-	create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh, knobh);
+	current->create_slider(id, label, juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag, knobh, knobh);
 }
 
 void JuceUiBuilder::create_feedback_slider_(const char *id, const char *label) {
-	create_slider(id, label, juce::Slider::SliderStyle::LinearHorizontal, 150, 20);
-    ed->subscribe_timer(id);
+	current->create_slider(id, label, juce::Slider::SliderStyle::LinearHorizontal, 150, 20);
+    current->ed->subscribe_timer(id);
 }
 
 void JuceUiBuilder::create_master_slider_(const char *id, const char *label) {
-	create_slider(id, label, juce::Slider::SliderStyle::LinearHorizontal, 150, 20);
+	current->create_slider(id, label, juce::Slider::SliderStyle::LinearHorizontal, 150, 20);
 }
 
 void JuceUiBuilder::create_selector_no_caption_(const char *id) {
-	create_combo(id, "");
+	current->create_combo(id, "");
 }
 
 void JuceUiBuilder::create_selector_(const char *id, const char *label) {
-	create_combo(id, label);
+	current->create_combo(id, label);
 }
 
 void JuceUiBuilder::create_simple_meter_(const char *id) {
-	create_f_slider(id, "", juce::Slider::LinearBarVertical, 15, 120);
+	current->create_f_slider(id, "", juce::Slider::LinearBarVertical, 15, 120);
 }
 
 void JuceUiBuilder::create_simple_c_meter_(const char *id, const char *idl, const char *label) {
-	create_slider(idl, label, juce::Slider::SliderStyle::LinearVertical, 40, 100);
-	create_f_slider(id, label, juce::Slider::LinearBarVertical, 5, 100);
+	current->create_slider(idl, label, juce::Slider::SliderStyle::LinearVertical, 40, 100);
+	current->create_f_slider(id, label, juce::Slider::LinearBarVertical, 5, 100);
 }
 
 void JuceUiBuilder::create_spin_value_(const char *id, const char *label) {
-	create_spin_box(id, label, juce::Slider::SliderStyle::LinearBarVertical, 60, 20);
+	current->create_spin_box(id, label, juce::Slider::SliderStyle::LinearBarVertical, 60, 20);
 }
 
 void JuceUiBuilder::create_switch_no_caption_(const char *sw_type, const char * id) {
     const char* label = get_label(sw_type);
-	create_text_button(id, label);
+	current->create_text_button(id, label);
 }
 
 void JuceUiBuilder::create_feedback_switch_(const char *sw_type, const char * id) {
 
     const char* label = get_label(sw_type);
-    create_f_button(id, label);
+    current->create_f_button(id, label);
 }
 
 void JuceUiBuilder::create_fload_switch_(const char *sw_type, const char * id, const char * idf) {
-    if (id) create_fload_button(id, idf, 220, texth+4);
+    if (id) current->create_fload_button(id, idf, 220, texth+4);
 }
 
 void JuceUiBuilder::create_switch_(const char *sw_type, const char * id, const char *label) {
-	create_text_button(id, label);
+	current->create_text_button(id, label);
 }
 
 void JuceUiBuilder::create_wheel_(const char * id, const char *label) {
@@ -754,16 +737,16 @@ void JuceUiBuilder::create_p_display_(const char *id, const char *idl, const cha
 }
 
 void JuceUiBuilder::create_simple_spin_value_(const char *id) {
-	create_spin_box(id, "", juce::Slider::SliderStyle::LinearBarVertical, 60, 20);
+	current->create_spin_box(id, "", juce::Slider::SliderStyle::LinearBarVertical, 60, 20);
 }
 
 void JuceUiBuilder::create_eq_rackslider_no_caption_(const char *id) {
-	create_f_slider(id, "", juce::Slider::LinearBar, 120, 15);
+	current->create_f_slider(id, "", juce::Slider::LinearBar, 120, 15);
 }
 
 void JuceUiBuilder::closeBox_() {
-	closebox();
-	inHide = false;
+	current->closebox();
+	current->inHide = false;
 }
 
 void JuceUiBuilder::load_glade_(const char *data) {
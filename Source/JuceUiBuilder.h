@@ -112,6 +112,10 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpinBox)
 };
 
+// Builds the widgets of a rack unit into a PluginEditor. The UiBuilder
+// callbacks have no context argument, they work on the builder the calling
+// thread constructed last. Builders don't share any state, one can be
+// nested in another. See UiDescription for load_ui() off the message thread.
 class JuceUiBuilder : public UiBuilder {
 private:
 	static void openTabBox_(const char* label);
@@ -150,42 +154,45 @@ private:
 	static void load_glade_(const char *data);
 	static void load_glade_file_(const char *fname);
 
-	static void create_slider(const char *id, const char *label, juce::Slider::SliderStyle style, int w, int h);
-	static void create_f_slider(const char *id, const char *label, juce::Slider::SliderStyle style, int w, int h);
-	static void create_combo(const char *id, const char *label);
-	static void create_button(const char *id, const char *label);
-	static void create_text_button(const char *id, const char *label);
-    static void create_f_button(const char *id, const char *label);
-    static void create_fload_button(const char *id, const char *label, int w, int h);
-	static void create_spin_box(const char *id, const char *label, juce::Slider::SliderStyle style, int w, int h);
-
-	static void addbox(bool vertical, const char* label);
-	static void closebox();
-	static void additem(juce::Component *c);
-	static void addspacer();
-	static void updateparentsize(int w, int h);
-	static std::list<juce::FlexBox *> boxes;
-	static std::list<juce::Component*> parents;
+	void create_slider(const char *id, const char *label, juce::Slider::SliderStyle style, int w, int h);
+	void create_f_slider(const char *id, const char *label, juce::Slider::SliderStyle style, int w, int h);
+	void create_combo(const char *id, const char *label);
+	void create_button(const char *id, const char *label);
+	void create_text_button(const char *id, const char *label);
+	void create_f_button(const char *id, const char *label);
+	void create_fload_button(const char *id, const char *label, int w, int h);
+	void create_spin_box(const char *id, const char *label, juce::Slider::SliderStyle style, int w, int h);
+
+	void addbox(bool vertical, const char* label);
+	void closebox();
+	void additem(juce::Component *c);
+	void addspacer();
+	void updateparentsize(int w, int h);
+	std::list<juce::FlexBox *> boxes;
+	std::list<juce::Component*> parents;
 	typedef std::pair<juce::FlexBox*, juce::TabbedComponent*> boxkey_t;
-	static std::list<std::pair<boxkey_t, juce::Point<int> > > boxstack;
-
-	static PluginEditor *ed;
-	static int flags;
-	static bool inHide;
-	static juce::Rectangle<int> *bounds;
+	std::list<std::pair<boxkey_t, juce::Point<int> > > boxstack;
 
+	PluginEditor *ed;
+	int flags;
+	bool inHide;
+	juce::Rectangle<int> *bounds;
+	int edx, edy;
+	JuceUiBuilder *previous;
 
 public:
 	JuceUiBuilder(PluginEditor *ed, PluginDef *pd, juce::Rectangle<int> *rect);
 	~JuceUiBuilder();
 
-	static void create_ir_combo(const char *id, const char *label);
-    static void create_tuner_display(gx_engine::GxMachine *machine);
+	void create_ir_combo(const char *id, const char *label);
+	void create_tuner_display(gx_engine::GxMachine *machine);
+
+	juce::Slider *lastslider;
+	juce::ToggleButton *lastbutton;
+	juce::TextButton *lasttextbutton;
+	juce::ComboBox *lastcombo;
 
-	static juce::Slider *lastslider;
-	static juce::ToggleButton *lastbutton;
-	static juce::TextButton *lasttextbutton;
-	static juce::ComboBox *lastcombo;
+	JUCE_DECLARE_NON_COPYABLE (JuceUiBuilder)
 };
 
 enum { texth = 24, knobh = 60, edtw=500, winh = 734};
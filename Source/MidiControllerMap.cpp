@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "MidiControllerMap.h"
+#include "guitarix.h"       // NOLINT
+
+static const char *curve_names[MidiControllerMap::num_curves] = {
+    "linear", "exponential", "logarithmic", "toggle"
+};
+
+MidiControllerMap::MidiControllerMap()
+    : readers(0), learning(false), learned(-1), ev_head(0), ev_count(0), ev_slot(0), reading(false)
+{
+    tables[0].reset(new Table());
+    tables[1].reset(new Table());
+    tables[0]->num = tables[1]->num = 0;
+    active = tables[0].get();
+}
+
+const char *MidiControllerMap::get_curve_name(int curve)
+{
+    return curve_names[juce::jlimit(0, num_curves - 1, curve)];
+}
+
+// position of CC value v on the parameter range, 0..1
+static float curve_value(int curve, bool invert, int v)
+{
+    float x = v / 127.0f;
+    if (invert) x = 1.0f - x;
+    switch (curve) {
+    case MidiControllerMap::exponential: return (std::exp2(6.0f * x) - 1.0f) / 63.0f;
+    case MidiControllerMap::logarithmic: return std::log2(1.0f + 63.0f * x) / 6.0f;
+    case MidiControllerMap::toggle: return x >= 0.5f ? 1.0f : 0.0f;
+    default: return x;
+    }
+}
+
+//==============================================================================
+// message thread
+
+void MidiControllerMap::publish()
+{
+    Table *t = active.load() == tables[0].get() ? tables[1].get() : tables[0].get();
+    t->num = 0;
+    for (auto& m : mappings) {
+        gx_engine::Parameter *p = m.param;
+        if (!p || !(p->isFloat() || p->isInt() || p->isBool()))
+            continue;
+        Slot& s = t->slots[t->num++];
+        s.cc = m.cc;
+        s.param = p;
+        s.deferred = !p->isFloat() || dynamic_cast<gx_engine::FloatEnumParameter*>(p)
+            || (m.id.size() > 7 && m.id.compare(m.id.size() - 7, 7, ".on_off") == 0);
+        float lower = p->isBool() ? 0.0f : p->getLowerAsFloat();
+        float upper = p->isBool() ? 1.0f : p->getUpperAsFloat();
+        for (int v = 0; v < 128; v++) {
+            float y = curve_value(m.curve, m.invert, v);
+            if (p->isBool())
+                s.values[v] = y > 0.5f ? 1.0f : 0.0f;
+            else if (p->isInt())
+                s.values[v] = std::round(lower + y * (upper - lower));
+            else
+                s.values[v] = lower + y * (upper - lower);
+        }
+    }
+    active.store(t);
+    // the old table is written by the next publish(), the audio thread
+    // must be done with it
+    while (readers.load() != 0)
+        juce::Thread::yield();
+}
+
+bool MidiControllerMap::set(const Mapping& m)
+{
+    for (auto& i : mappings) {
+        if (i.id == m.id) {
+            i = m;
+            publish();
+            return true;
+        }
+    }
+    if (int(mappings.size()) >= max_mappings)
+        return false;
+    mappings.push_back(m);
+    publish();
+    return true;
+}
+
+void MidiControllerMap::set_param(const std::string& id, gx_engine::Parameter *param)
+{
+    for (auto& i : mappings) {
+        if (i.id == id) {
+            i.param = param;
+            publish();
+            return;
+        }
+    }
+}
+
+void MidiControllerMap::remove(const std::string& id)
+{
+    for (auto i = mappings.begin(); i != mappings.end(); ++i) {
+        if (i->id == id) {
+            mappings.erase(i);
+            publish();
+            return;
+        }
+    }
+}
+
+void MidiControllerMap::clear()
+{
+    mappings.clear();
+    publish();
+}
+
+const MidiControllerMap::Mapping *MidiControllerMap::find(const std::string& id) const
+{
+    for (auto& i : mappings)
+        if (i.id == id)
+            return &i;
+    return nullptr;
+}
+
+void MidiControllerMap::learn(const std::string& id)
+{
+    learning = false;
+    learned = -1;
+    learn_id = id;
+    learning = true;
+}
+
+void MidiControllerMap::cancel_learn()
+{
+    learning = false;
+    learned = -1;
+    learn_id.clear();
+}
+
+bool MidiControllerMap::is_learning(const std::string& id) const
+{
+    return learning && learn_id == id;
+}
+
+int MidiControllerMap::poll_learned(std::string& id)
+{
+    if (learning || learned.load() < 0)
+        return -1;
+    int cc = learned.exchange(-1);
+    id = learn_id;
+    learn_id.clear();
+    return id.empty() ? -1 : cc;
+}
+
+std::unique_ptr<juce::XmlElement> MidiControllerMap::to_xml() const
+{
+    auto xml = std::make_unique<juce::XmlElement>("MIDICC");
+    for (auto& m : mappings) {
+        auto *e = xml->createNewChildElement("MAP");
+        e->setAttribute("id", juce::String(m.id));
+        e->setAttribute("cc", m.cc);
+        e->setAttribute("curve", get_curve_name(m.curve));
+        e->setAttribute("invert", m.invert);
+    }
+    return xml;
+}
+
+void MidiControllerMap::from_xml(const juce::XmlElement& xml,
+                                 const std::function<gx_engine::Parameter*(const std::string& id)>& find_param)
+{
+    mappings.clear();
+    for (auto *e : xml.getChildWithTagNameIterator("MAP")) {
+        Mapping m;
+        m.id = e->getStringAttribute("id").toStdString();
+        m.cc = e->getIntAttribute("cc", -1);
+        if (m.id.empty() || m.cc < 0 || m.cc > 127 || int(mappings.size()) >= max_mappings)
+            continue;
+        m.curve = linear;
+        for (int c = 0; c < num_curves; c++)
+            if (e->getStringAttribute("curve") == curve_names[c])
+                m.curve = c;
+        m.invert = e->getBoolAttribute("invert");
+        // kept without a parameter while its plugin isn't loaded
+        m.param = find_param(m.id);
+        mappings.push_back(m);
+    }
+    publish();
+}
+
+//==============================================================================
+// audio thread
+
+void MidiControllerMap::add_event(int cc, int value, juce::int64 pos)
+{
+    if (learning.load(std::memory_order_relaxed)) {
+        learned = cc;
+        learning = false;
+        return;
+    }
+    if (ev_count == max_events)
+        return;     // a CC flood, the rest of it is dropped
+    events[(ev_head + ev_count++) % max_events] = { pos, cc, value & 0x7f };
+}
+
+bool MidiControllerMap::next_event(juce::int64 until, Event& e)
+{
+    // held until the last call, set_param() waits for it before the
+    // engine deletes a parameter
+    if (!reading) {
+        readers.fetch_add(1);
+        reading = true;
+    }
+    const Table *t = active.load();
+    while (ev_count && events[ev_head].pos < until) {
+        const Queued& q = events[ev_head];
+        while (ev_slot < t->num && t->slots[ev_slot].cc != q.cc)
+            ev_slot++;
+        if (ev_slot < t->num) {
+            const Slot& s = t->slots[ev_slot++];
+            e = { q.pos, s.param, s.values[q.value], s.deferred };
+            return true;
+        }
+        ev_head = (ev_head + 1) % max_events;
+        ev_count--;
+        ev_slot = 0;
+    }
+    reading = false;
+    readers.fetch_sub(1);
+    return false;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace gx_engine { class Parameter; }
+
+//==============================================================================
+/*
+** MIDI CC to engine parameter map for the host's MIDI stream.
+**
+** Every mapping holds a 128 step table of parameter values, built from
+** the parameter range and a curve when the mapping is made, so the audio
+** thread only looks the value up. The message thread edits a copy of the
+** table and swaps it in, then waits until the audio thread has left the
+** old one.
+**
+** add_event() queues the CC value with its stream position (host samples
+** since prepareToPlay), next_event() hands the values out up to the end
+** of the quantum that is about to run. The mappings of a CC are looked up
+** only then, so a parameter that went with its plugin in between is not
+** touched. Only plain continuous parameters are meant to be written on
+** the audio thread: switches, selectors and enums come out as deferred,
+** for the message thread, as they change the rack.
+**
+** learn() makes the next CC on any channel the controller of a parameter,
+** the message thread picks it up with poll_learned().
+*/
+class MidiControllerMap
+{
+public:
+    enum Curve { linear, exponential, logarithmic, toggle, num_curves };
+
+    struct Mapping
+    {
+        std::string id;
+        gx_engine::Parameter *param;
+        int cc, curve;
+        bool invert;
+    };
+
+    struct Event
+    {
+        juce::int64 pos;
+        gx_engine::Parameter *param;
+        float value;
+        bool deferred;      // set it on the message thread
+    };
+
+    static const int max_mappings = 64;
+    static const int max_events = 512;
+
+    MidiControllerMap();
+
+    // message thread
+    // adds or replaces the mapping of m.id, false when the map is full
+    bool set(const Mapping& m);
+    // the parameter of id came or went with its plugin
+    void set_param(const std::string& id, gx_engine::Parameter *param);
+    void remove(const std::string& id);
+    void clear();
+    const Mapping *find(const std::string& id) const;
+    const std::vector<Mapping>& get_mappings() const { return mappings; }
+    static const char *get_curve_name(int curve);
+
+    void learn(const std::string& id);
+    void cancel_learn();
+    bool is_learning(const std::string& id) const;
+    // returns the CC that was learned for the pending id, or -1
+    int poll_learned(std::string& id);
+
+    std::unique_ptr<juce::XmlElement> to_xml() const;
+    void from_xml(const juce::XmlElement& xml,
+                  const std::function<gx_engine::Parameter*(const std::string& id)>& find_param);
+
+    // audio thread
+    void add_event(int cc, int value, juce::int64 pos);
+    // call until it returns false, the parameters of the events stay
+    // valid until then
+    bool next_event(juce::int64 until, Event& e);
+    void reset_events() { ev_head = ev_count = ev_slot = 0; }
+
+private:
+    struct Slot
+    {
+        int cc;
+        gx_engine::Parameter *param;
+        bool deferred;
+        float values[128];
+    };
+    struct Queued
+    {
+        juce::int64 pos;
+        int cc, value;
+    };
+    struct Table
+    {
+        int num;
+        Slot slots[max_mappings];
+    };
+
+    void publish();
+
+    std::vector<Mapping> mappings;
+    std::unique_ptr<Table> tables[2];
+    std::atomic<Table*> active;
+    std::atomic<int> readers;
+
+    std::string learn_id;
+    std::atomic<bool> learning;
+    std::atomic<int> learned;
+
+    Queued events[max_events];
+    int ev_head, ev_count;
+    int ev_slot;            // next slot of the table for the head event
+    bool reading;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiControllerMap)
+};
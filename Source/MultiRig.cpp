@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+** multirig: several guitarix rigs on one multichannel interface, no GUI.
+**
+**   multirig [-t type] [-d device] [-r rate] [-b blocksize] [-c cpu] [-l]
+**            [bank:]preset ...
+**
+** Every preset argument starts one GuitarixProcessor. Rig k takes input
+** channels 2k and 2k+1 of the device, writes output channels 2k and 2k+1
+** and listens to MIDI channel k+1 on all MIDI inputs. "-" keeps the
+** preset the instance starts with.
+**
+** The rigs of one device cycle run side by side on a RackThreadPool: the
+** device thread processes the first rig, helpers pinned to the cores from
+** -c on (default 1) take the others, and the cycle ends when the last rig
+** is done. The instances only share the guitarix command line options
+** (GuitarixStart::options), everything else (engines, presets, IRs) is
+** their own.
+*/
+
+#include <JuceHeader.h>
+#include "GuitarixProcessor.h"
+#include "RackThreadPool.h"
+#include <chrono>
+#include <csignal>
+
+static std::atomic<bool> quit { false };
+
+static void on_signal(int)
+{
+    quit = true;
+}
+
+static juce::uint32 cpu_mask(int cpu)
+{
+    int ncpus = juce::jmin(32, juce::SystemStats::getNumCpus());
+    return juce::uint32(1) << (((cpu % ncpus) + ncpus) % ncpus);
+}
+
+//==============================================================================
+class MultiRig : public juce::AudioIODeviceCallback,
+                 public juce::MidiInputCallback
+{
+public:
+    struct Rig
+    {
+        std::unique_ptr<GuitarixProcessor> proc;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        juce::MidiMessageCollector midiIn;
+        int channel;    // first device channel of the pair
+
+        // set by the device thread for the current cycle
+        const float* const* inputs;
+        int numInputs;
+        float* const* outputs;
+        int numOutputs;
+        int numSamples;
+    };
+
+    MultiRig(int count, int first_cpu)
+        : pool(count - 1), pinned(false), cpu(first_cpu),
+          cycles(0), overruns(0), load_sum(0), load_max(0)
+    {
+        for (int i = 0; i < count; i++) {
+            auto r = std::make_unique<Rig>();
+            r->proc.reset(new GuitarixProcessor());
+            r->channel = 2 * i;
+            rigs.push_back(std::move(r));
+        }
+        tasks.resize(count);
+        for (int i = 0; i < count; i++)
+            tasks[i] = { process_rig, rigs[i].get() };
+        pool.set_affinity(first_cpu);
+        pool.start();
+    }
+
+    ~MultiRig() override
+    {
+        pool.stop();
+    }
+
+    int get_num_rigs() const { return int(rigs.size()); }
+    GuitarixProcessor& get_processor(int i) { return *rigs[i]->proc; }
+
+    // returns average and worst cycle load since the last call, and the
+    // cycles that took longer than the device period
+    void get_load(double& avg, double& worst, juce::uint32& over)
+    {
+        juce::uint32 n = cycles.exchange(0);
+        avg = n ? load_sum.exchange(0) / 1e6 / n : 0.0;
+        worst = load_max.exchange(0) / 1e6;
+        over = overruns.exchange(0);
+    }
+
+    void audioDeviceAboutToStart(juce::AudioIODevice *device) override
+    {
+        double rate = device->getCurrentSampleRate();
+        int bs = device->getCurrentBufferSizeSamples();
+        for (auto& r : rigs) {
+            r->proc->setPlayConfigDetails(2, 2, rate, bs);
+            r->proc->prepareToPlay(rate, bs);
+            r->buffer.setSize(2, bs);
+            r->midi.ensureSize(2048);
+            r->midiIn.reset(rate);
+        }
+        samplerate = rate;
+        pinned = false;
+    }
+
+    void audioDeviceStopped() override
+    {
+        for (auto& r : rigs)
+            r->proc->releaseResources();
+    }
+
+    void audioDeviceIOCallbackWithContext(const float* const* inputs, int numInputs,
+                                          float* const* outputs, int numOutputs, int numSamples,
+                                          const juce::AudioIODeviceCallbackContext&) override
+    {
+        if (!pinned) {
+            // the device thread gets the core before the helpers
+            juce::Thread::setCurrentThreadAffinityMask(cpu_mask(cpu - 1));
+            pinned = true;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        for (auto& r : rigs) {
+            r->inputs = inputs;
+            r->numInputs = numInputs;
+            r->outputs = outputs;
+            r->numOutputs = numOutputs;
+            r->numSamples = numSamples;
+        }
+        pool.run(tasks.data(), int(tasks.size()));
+        for (int c = 2 * int(rigs.size()); c < numOutputs; c++)
+            if (outputs[c])
+                juce::FloatVectorOperations::clear(outputs[c], numSamples);
+
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        double period = 1e6 * numSamples / samplerate;
+        juce::int64 load = juce::int64(1e6 * us / period);
+        cycles.fetch_add(1, std::memory_order_relaxed);
+        load_sum.fetch_add(load, std::memory_order_relaxed);
+        if (load > load_max.load(std::memory_order_relaxed))
+            load_max.store(load, std::memory_order_relaxed);
+        if (us > period)
+            overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void handleIncomingMidiMessage(juce::MidiInput*, const juce::MidiMessage& msg) override
+    {
+        int ch = msg.getChannel();
+        if (ch >= 1 && ch <= int(rigs.size()))
+            rigs[ch - 1]->midiIn.addMessageToQueue(msg);
+    }
+
+private:
+    static void process_rig(void *arg)
+    {
+        Rig& r = *static_cast<Rig*>(arg);
+        int n = r.numSamples;
+        r.buffer.setSize(2, n, false, false, true);
+        for (int c = 0; c < 2; c++) {
+            int d = r.channel + c;
+            if (d < r.numInputs && r.inputs[d])
+                r.buffer.copyFrom(c, 0, r.inputs[d], n);
+            else
+                r.buffer.clear(c, 0, n);
+        }
+        r.midi.clear();
+        r.midiIn.removeNextBlockOfMessages(r.midi, n);
+        r.proc->processBlock(r.buffer, r.midi);
+        for (int c = 0; c < 2; c++) {
+            int d = r.channel + c;
+            if (d < r.numOutputs && r.outputs[d])
+                juce::FloatVectorOperations::copy(r.outputs[d], r.buffer.getReadPointer(c), n);
+        }
+    }
+
+    std::vector<std::unique_ptr<Rig>> rigs;
+    std::vector<RackThreadPool::Task> tasks;
+    RackThreadPool pool;
+    bool pinned;
+    int cpu;
+    double samplerate = 48000.0;
+    std::atomic<juce::uint32> cycles, overruns;
+    std::atomic<juce::int64> load_sum, load_max;   // load in ppm of the device period
+
+    JUCE_DECLARE_NON_COPYABLE (MultiRig)
+};
+
+//==============================================================================
+static void list_devices(juce::AudioDeviceManager& dm)
+{
+    for (auto *type : dm.getAvailableDeviceTypes()) {
+        type->scanForDevices();
+        printf("%s\n", type->getTypeName().toRawUTF8());
+        for (auto& name : type->getDeviceNames(false))
+            printf("    %s\n", name.toRawUTF8());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    juce::String type, device;
+    int rate = 0, blocksize = 0, first_cpu = 1;
+    bool list = false;
+    juce::StringArray presets;
+    for (int i = 1; i < argc; i++) {
+        juce::String a(argv[i]);
+        bool arg = i + 1 < argc;
+        if (a == "-t" && arg) type = argv[++i];
+        else if (a == "-d" && arg) device = argv[++i];
+        else if (a == "-r" && arg) rate = atoi(argv[++i]);
+        else if (a == "-b" && arg) blocksize = atoi(argv[++i]);
+        else if (a == "-c" && arg) first_cpu = atoi(argv[++i]);
+        else if (a == "-l") list = true;
+        else if (!a.startsWith("-") || a == "-") presets.add(a);
+        else {
+            fprintf(stderr, "usage: %s [-t type] [-d device] [-r rate] [-b blocksize] [-c cpu] [-l] [bank:]preset ...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    juce::ScopedJuceInitialiser_GUI juce_init;
+    juce::AudioDeviceManager dm;
+    if (list) {
+        list_devices(dm);
+        return 0;
+    }
+    if (presets.isEmpty()) {
+        fprintf(stderr, "no rigs given\n");
+        return 1;
+    }
+
+    int n = presets.size();
+    MultiRig multi(n, first_cpu);
+
+    if (type.isNotEmpty())
+        dm.setCurrentAudioDeviceType(type, false);
+    juce::AudioDeviceManager::AudioDeviceSetup setup;
+    setup.inputDeviceName = setup.outputDeviceName = device;
+    setup.sampleRate = rate;
+    setup.bufferSize = blocksize;
+    setup.useDefaultInputChannels = setup.useDefaultOutputChannels = false;
+    setup.inputChannels.setRange(0, 2 * n, true);
+    setup.outputChannels.setRange(0, 2 * n, true);
+    juce::String err = dm.initialise(2 * n, 2 * n, nullptr, device.isEmpty(), device, &setup);
+    auto *dev = dm.getCurrentAudioDevice();
+    if (err.isNotEmpty() || !dev) {
+        fprintf(stderr, "can't open audio device: %s\n", err.toRawUTF8());
+        return 1;
+    }
+    int ins = dev->getActiveInputChannels().countNumberOfSetBits();
+    int outs = dev->getActiveOutputChannels().countNumberOfSetBits();
+    if (ins < 2 * n || outs < 2 * n)
+        fprintf(stderr, "warning: %s has %d inputs and %d outputs, %d rigs need %d\n",
+                dev->getName().toRawUTF8(), ins, outs, n, 2 * n);
+    dm.addAudioCallback(&multi);
+    for (auto& m : juce::MidiInput::getAvailableDevices()) {
+        dm.setMidiInputDeviceEnabled(m.identifier, true);
+        dm.addMidiInputDeviceCallback(m.identifier, &multi);
+    }
+    // presets are loaded into running rigs, like a host does after
+    // prepareToPlay
+    for (int i = 0; i < n; i++) {
+        const juce::String& p = presets[i];
+        if (p == "-") continue;
+        gx_jack::GxJack *jack;
+        gx_engine::GxMachine *machine;
+        multi.get_processor(i).get_machine_jack(jack, machine, false);
+        std::string bank = machine->get_settings().get_current_bank(), name = p.toStdString();
+        if (p.containsChar(':')) {
+            bank = p.upToFirstOccurrenceOf(":", false, false).toStdString();
+            name = p.fromFirstOccurrenceOf(":", false, false).toStdString();
+        }
+        multi.get_processor(i).load_preset(bank, name);
+    }
+    printf("%d rigs on %s, %d Hz, %d samples\n", n, dev->getName().toRawUTF8(),
+           int(dev->getCurrentSampleRate()), dev->getCurrentBufferSizeSamples());
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    int ticks = 0;
+    while (!quit) {
+        juce::MessageManager::getInstance()->runDispatchLoopUntil(200);
+        if (++ticks % 50) continue;
+        double avg, worst;
+        juce::uint32 over;
+        multi.get_load(avg, worst, over);
+        printf("load %.1f%% avg, %.1f%% worst, %u cycles over the period\n", 100 * avg, 100 * worst, over);
+        fflush(stdout);
+    }
+
+    dm.removeAudioCallback(&multi);
+    for (auto& m : juce::MidiInput::getAvailableDevices())
+        dm.removeMidiInputDeviceCallback(m.identifier, &multi);
+    dm.closeAudioDevice();
+    for (int i = 0; i < n; i++)
+        printf("rig %d: %s\n", i + 1, multi.get_processor(i).get_telemetry().get_summary().toRawUTF8());
+    return 0;
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "OnlineCatalog.h"
+#include "JsonScanner.h"
+#include <algorithm>
+#include <unordered_map>
+
+static const char cache_magic[] = "GXCATIDX2";
+static const char word_breaks[] = " \t,;:/-_.()[]\"'";
+
+bool OnlineCatalog::Entry::operator==(const Entry& o) const
+{
+    return name == o.name && file == o.file && description == o.description
+        && author == o.author && tags == o.tags;
+}
+
+std::string OnlineCatalog::Entry::get_info() const
+{
+    return description + "Author : " + author;
+}
+
+juce::File OnlineCatalog::get_cache_file(const juce::File& list)
+{
+    return list.getSiblingFile("." + list.getFileName() + ".idx");
+}
+
+bool OnlineCatalog::load(const juce::File& list)
+{
+    juce::int64 size = list.getSize();
+    juce::int64 mtime = list.getLastModificationTime().toMilliseconds();
+    if (!list.existsAsFile())
+        return !entries.empty();
+    if (size == list_size && mtime == list_mtime)
+        return true;
+    juce::File cache = get_cache_file(list);
+    if (entries.empty() && read_cache(cache) && list_size == size && list_mtime == mtime)
+        return true;
+
+    std::vector<Entry> fresh;
+    {
+        juce::MemoryMappedFile map(list, juce::MemoryMappedFile::readOnly);
+        if (!map.getData() || !parse(static_cast<const char*>(map.getData()), map.getSize(), fresh))
+            return !entries.empty();
+    }
+    merge(fresh);
+    list_size = size;
+    list_mtime = mtime;
+    write_cache(cache);
+    return true;
+}
+
+std::vector<juce::uint32> OnlineCatalog::get_all() const
+{
+    std::vector<juce::uint32> r(entries.size());
+    for (size_t i = 0; i < r.size(); i++)
+        r[i] = juce::uint32(i);
+    return r;
+}
+
+std::vector<juce::uint32> OnlineCatalog::search(const juce::String& query) const
+{
+    juce::StringArray words;
+    words.addTokens(query.toLowerCase(), word_breaks, "");
+    words.removeEmptyStrings();
+    if (words.isEmpty())
+        return get_all();
+    std::vector<juce::uint32> result;
+    for (int w = 0; w < words.size(); w++) {
+        // union of the entries of all terms starting with the word
+        std::string prefix = words[w].toStdString();
+        std::vector<juce::uint32> hits;
+        for (auto t = terms.lower_bound(prefix); t != terms.end() && t->first.compare(0, prefix.size(), prefix) == 0; ++t) {
+            std::vector<juce::uint32> u;
+            std::set_union(hits.begin(), hits.end(), t->second.begin(), t->second.end(), std::back_inserter(u));
+            hits.swap(u);
+        }
+        if (w == 0) {
+            result.swap(hits);
+        } else {
+            std::vector<juce::uint32> r;
+            std::set_intersection(result.begin(), result.end(), hits.begin(), hits.end(), std::back_inserter(r));
+            result.swap(r);
+        }
+        if (result.empty())
+            break;
+    }
+    return result;
+}
+
+std::vector<juce::uint32> OnlineCatalog::with_tag(const std::string& tag) const
+{
+    auto t = tags.find(tag);
+    return t == tags.end() ? std::vector<juce::uint32>() : t->second;
+}
+
+std::vector<std::pair<std::string, int>> OnlineCatalog::get_tags(size_t max) const
+{
+    std::vector<std::pair<std::string, int>> r;
+    r.reserve(tags.size());
+    for (auto& t : tags)
+        r.emplace_back(t.first, int(t.second.size()));
+    std::stable_sort(r.begin(), r.end(), [](auto& a, auto& b) { return a.second > b.second; });
+    if (r.size() > max)
+        r.resize(max);
+    return r;
+}
+
+static void read_string(JsonScanner& jp, std::string& v)
+{
+    if (jp.peek() == JsonScanner::value_string) {
+        jp.next();
+        v = jp.current_value();
+    } else {
+        jp.skip_object();   // null
+    }
+}
+
+bool OnlineCatalog::parse(const char *data, size_t size, std::vector<Entry>& entries)
+{
+    JsonScanner jp(data, size);
+    try {
+        jp.next(JsonScanner::begin_array);
+        while (jp.peek() == JsonScanner::begin_object) {
+            Entry e;
+            jp.next(JsonScanner::begin_object);
+            while (jp.peek() == JsonScanner::value_key) {
+                jp.next();
+                std::string_view key = jp.current_value();
+                if (key == "name") {
+                    read_string(jp, e.name);
+                } else if (key == "description") {
+                    read_string(jp, e.description);
+                } else if (key == "author") {
+                    read_string(jp, e.author);
+                } else if (key == "file") {
+                    read_string(jp, e.file);
+                } else if (key == "tags" && jp.peek() == JsonScanner::begin_array) {
+                    jp.next();
+                    while (jp.peek() != JsonScanner::end_array) {
+                        std::string tag;
+                        read_string(jp, tag);
+                        if (!tag.empty())
+                            e.tags.push_back(juce::String(tag).toLowerCase().toStdString());
+                    }
+                    jp.next(JsonScanner::end_array);
+                } else {
+                    jp.skip_object();
+                }
+            }
+            jp.next(JsonScanner::end_object);
+            if (!e.file.empty())
+                entries.push_back(std::move(e));
+        }
+        jp.next(JsonScanner::end_array);
+    } catch (JsonScanner::Error& e) {
+        DBG("online preset list: " << e.what());
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> OnlineCatalog::get_terms(const Entry& e)
+{
+    juce::StringArray words;
+    for (auto *s : { &e.name, &e.author })
+        words.addTokens(juce::String::fromUTF8(s->c_str()).toLowerCase(), word_breaks, "");
+    for (auto& t : e.tags)
+        words.addTokens(juce::String::fromUTF8(t.c_str()).toLowerCase(), word_breaks, "");
+    words.removeEmptyStrings();
+    words.removeDuplicates(false);
+    std::vector<std::string> r;
+    r.reserve(size_t(words.size()));
+    for (auto& w : words)
+        r.push_back(w.toStdString());
+    return r;
+}
+
+// entries are renumbered in the order of fresh, the terms of unchanged
+// entries are kept, new and changed entries are split into words
+void OnlineCatalog::merge(std::vector<Entry>& fresh)
+{
+    std::unordered_map<std::string, juce::uint32> old_ids;
+    for (size_t i = 0; i < entries.size(); i++)
+        old_ids.emplace(entries[i].file, juce::uint32(i));
+    std::vector<juce::int64> renumber(entries.size(), -1);
+    std::vector<juce::uint32> added;
+    for (size_t i = 0; i < fresh.size(); i++) {
+        auto o = old_ids.find(fresh[i].file);
+        if (o != old_ids.end() && renumber[o->second] < 0 && entries[o->second] == fresh[i])
+            renumber[o->second] = juce::int64(i);
+        else
+            added.push_back(juce::uint32(i));
+    }
+    for (auto t = terms.begin(); t != terms.end(); ) {
+        std::vector<juce::uint32> ids;
+        ids.reserve(t->second.size());
+        for (auto id : t->second)
+            if (renumber[id] >= 0)
+                ids.push_back(juce::uint32(renumber[id]));
+        if (ids.empty()) {
+            t = terms.erase(t);
+        } else {
+            std::sort(ids.begin(), ids.end());
+            t->second.swap(ids);
+            ++t;
+        }
+    }
+    entries.swap(fresh);
+    fresh.clear();
+    for (auto id : added)
+        add_terms(id);
+    build_tags();
+}
+
+void OnlineCatalog::add_terms(juce::uint32 id)
+{
+    for (auto& t : get_terms(entries[id])) {
+        auto& ids = terms[t];
+        auto i = std::lower_bound(ids.begin(), ids.end(), id);
+        if (i == ids.end() || *i != id)
+            ids.insert(i, id);
+    }
+}
+
+void OnlineCatalog::build_tags()
+{
+    tags.clear();
+    for (size_t i = 0; i < entries.size(); i++)
+        for (auto& t : entries[i].tags) {
+            auto& ids = tags[t];
+            if (ids.empty() || ids.back() != i)
+                ids.push_back(juce::uint32(i));
+        }
+}
+
+bool OnlineCatalog::read_cache(const juce::File& idx)
+{
+    juce::MemoryBlock mb;
+    if (!idx.loadFileAsData(mb))
+        return false;
+    juce::MemoryInputStream in(mb, false);
+    if (in.readString() != cache_magic)
+        return false;
+    juce::int64 size = in.readInt64();
+    juce::int64 mtime = in.readInt64();
+    int n = in.readInt();
+    if (n < 0 || n > in.getTotalLength())
+        return false;
+    std::vector<Entry> ent(static_cast<size_t>(n));
+    for (auto& e : ent) {
+        e.name = in.readString().toStdString();
+        e.file = in.readString().toStdString();
+        e.description = in.readString().toStdString();
+        e.author = in.readString().toStdString();
+        int nt = in.readInt();
+        if (nt < 0 || in.isExhausted())
+            return false;
+        for (int i = 0; i < nt; i++)
+            e.tags.push_back(in.readString().toStdString());
+    }
+    std::map<std::string, std::vector<juce::uint32>> tm;
+    int nterms = in.readInt();
+    for (int i = 0; i < nterms; i++) {
+        auto& ids = tm[in.readString().toStdString()];
+        int c = in.readInt();
+        if (c <= 0 || in.isExhausted())
+            return false;
+        ids.resize(size_t(c));
+        for (auto& id : ids) {
+            id = juce::uint32(in.readInt());
+            if (id >= juce::uint32(n))
+                return false;
+        }
+    }
+    entries.swap(ent);
+    terms.swap(tm);
+    build_tags();
+    list_size = size;
+    list_mtime = mtime;
+    return true;
+}
+
+// best effort like the bank index
+void OnlineCatalog::write_cache(const juce::File& idx) const
+{
+    juce::TemporaryFile tmp(idx);
+    {
+        juce::FileOutputStream out(tmp.getFile());
+        if (!out.openedOk())
+            return;
+        out.writeString(cache_magic);
+        out.writeInt64(list_size);
+        out.writeInt64(list_mtime);
+        out.writeInt(int(entries.size()));
+        for (auto& e : entries) {
+            out.writeString(juce::String::fromUTF8(e.name.c_str()));
+            out.writeString(juce::String::fromUTF8(e.file.c_str()));
+            out.writeString(juce::String::fromUTF8(e.description.c_str()));
+            out.writeString(juce::String::fromUTF8(e.author.c_str()));
+            out.writeInt(int(e.tags.size()));
+            for (auto& t : e.tags)
+                out.writeString(juce::String::fromUTF8(t.c_str()));
+        }
+        out.writeInt(int(terms.size()));
+        for (auto& t : terms) {
+            out.writeString(juce::String::fromUTF8(t.first.c_str()));
+            out.writeInt(int(t.second.size()));
+            for (auto id : t.second)
+                out.writeInt(int(id));
+        }
+        out.flush();
+        if (out.getStatus().failed())
+            return;
+    }
+    tmp.overwriteTargetFileWithTemporary();
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+/*
+** The online preset list (musical-artifacts.com artifacts.json) as a
+** catalog that can be searched.
+**
+** Every word of the name, author and tags of an entry (lower case) is a
+** term of an inverted index pointing to the entries that have it, search()
+** matches the words of a query as prefixes of terms. Entries are numbered
+** in list order, lists of entries are always sorted by number.
+**
+** The catalog is kept in ".<list>.idx" next to the list, keyed by size and
+** modification time of the list, so the next start reads it without
+** parsing the JSON or splitting words. When the list was downloaded again
+** the new one is merged: entries that didn't change (by file url) keep
+** their terms, only new and changed ones are split into words.
+**
+** Message thread.
+*/
+class OnlineCatalog
+{
+public:
+    struct Entry
+    {
+        std::string name, file, description, author;
+        std::vector<std::string> tags;
+
+        bool operator==(const Entry& o) const;
+        // text for the download dialog
+        std::string get_info() const;
+    };
+
+    // the catalog of list, merged from the list when the index is out of
+    // date, false when neither can be read
+    bool load(const juce::File& list);
+
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+    const Entry& get(size_t i) const { return entries[i]; }
+
+    std::vector<juce::uint32> get_all() const;
+    // entries where every word of query starts a term
+    std::vector<juce::uint32> search(const juce::String& query) const;
+    std::vector<juce::uint32> with_tag(const std::string& tag) const;
+    // the tags with the most entries, with their count
+    std::vector<std::pair<std::string, int>> get_tags(size_t max) const;
+
+    static bool parse(const char *data, size_t size, std::vector<Entry>& entries);
+    static std::vector<std::string> get_terms(const Entry& e);
+
+private:
+    void merge(std::vector<Entry>& fresh);
+    void add_terms(juce::uint32 id);
+    void build_tags();
+    bool read_cache(const juce::File& idx);
+    void write_cache(const juce::File& idx) const;
+    static juce::File get_cache_file(const juce::File& list);
+
+    std::vector<Entry> entries;
+    std::map<std::string, std::vector<juce::uint32>> terms;
+    std::map<std::string, std::vector<juce::uint32>> tags;
+    juce::int64 list_size = -1, list_mtime = -1;
+};
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Oversampler.h"
+
+Oversampler::Oversampler()
+    : factor(1), quality(normal), maxBlock(0), latency(0), channels(0)
+{
+}
+
+int Oversampler::get_filter_length(int q)
+{
+    // zita-resampler accepts 16..96, 32 is what gx_resampler uses
+    static const int hlen[] = { 16, 32, 64 };
+    return hlen[juce::jlimit(0, 2, q)];
+}
+
+bool Oversampler::prime(Resampler& r)
+{
+    // fill the delay line with silence, the same way BufferResampler does
+    r.inp_count = r.inpsize() / 2 - 1;
+    r.inp_data = nullptr;
+    r.out_count = 1;
+    r.out_data = nullptr;
+    return r.process() == 0;
+}
+
+bool Oversampler::setup(int rate, int f, int q, int block, int nchan)
+{
+    factor = 1;
+    latency = 0;
+    quality = q;
+    maxBlock = block;
+    channels = juce::jlimit(1, 2, nchan);
+    for (int c = 0; c < 2; c++) {
+        r_up[c].clear();
+        r_down[c].clear();
+    }
+    if (f <= 1) {
+        buffer.setSize(channels, 0);
+        return true;
+    }
+    int hlen = get_filter_length(q);
+    for (int c = 0; c < channels; c++) {
+        if (r_up[c].setup(rate, rate * f, 1, hlen) != 0
+            || r_down[c].setup(rate * f, rate, 1, hlen) != 0
+            || !prime(r_up[c]) || !prime(r_down[c])) {
+            return false;
+        }
+    }
+    buffer.setSize(channels, block * f);
+    factor = f;
+    latency = (r_up[0].inpsize() / 2 - 1) + (r_down[0].inpsize() / 2 - 1) / f;
+    return true;
+}
+
+void Oversampler::reset()
+{
+    if (factor <= 1) return;
+    for (int c = 0; c < channels; c++) {
+        r_up[c].reset();
+        r_down[c].reset();
+        prime(r_up[c]);
+        prime(r_down[c]);
+    }
+}
+
+float *const *Oversampler::up(float *const *in, int n)
+{
+    jassert(n <= maxBlock);
+    for (int c = 0; c < channels; c++) {
+        Resampler& r = r_up[c];
+        r.inp_count = n;
+        r.inp_data = in[c];
+        r.out_count = n * factor;
+        r.out_data = buffer.getWritePointer(c);
+        r.process();
+        // does not happen with integer ratios once primed, but never
+        // hand out stale samples
+        if (r.out_count)
+            juce::FloatVectorOperations::clear(r.out_data, (int) r.out_count);
+    }
+    return buffer.getArrayOfWritePointers();
+}
+
+void Oversampler::down(float *const *out, int n)
+{
+    for (int c = 0; c < channels; c++) {
+        Resampler& r = r_down[c];
+        r.inp_count = n * factor;
+        r.inp_data = buffer.getWritePointer(c);
+        r.out_count = n;
+        r.out_data = out[c];
+        r.process();
+        if (r.out_count)
+            juce::FloatVectorOperations::clear(r.out_data, (int) r.out_count);
+    }
+}
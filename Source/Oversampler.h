@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <zita-resampler/resampler.h>
+
+//==============================================================================
+/*
+** 2x/4x/8x oversampling around one rack unit, built from the polyphase
+** filters of the bundled zita-resampler.
+**
+** up() turns n engine rate samples per channel into n * factor samples in
+** an internal buffer, down() filters that back into the unit's output.
+** Both resamplers are primed with silence, so every block maps to exactly
+** n * factor samples and back, at a constant latency of get_latency()
+** engine samples.
+*/
+class Oversampler
+{
+public:
+    enum Quality { draft, normal, high };
+
+    Oversampler();
+
+    // not realtime safe, factor 1 switches oversampling off
+    bool setup(int rate, int factor, int quality, int maxBlock, int channels = 2);
+    void reset();
+
+    int get_factor() const { return factor; }
+    int get_quality() const { return quality; }
+    int get_max_block() const { return maxBlock; }
+    int get_latency() const { return latency; }
+
+    // n <= get_max_block(), returns the oversampled channels
+    float *const *up(float *const *in, int n);
+    void down(float *const *out, int n);
+
+    static int get_filter_length(int quality);
+
+private:
+    static bool prime(Resampler& r);
+
+    int factor, quality, maxBlock, latency, channels;
+    Resampler r_up[2], r_down[2];
+    juce::AudioBuffer<float> buffer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Oversampler)
+};
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "ParamEventQueue.h"
+
+ParamEventQueue::ParamEventQueue(int capacity)
+    : cells(juce::nextPowerOfTwo(juce::jmax(2, capacity))),
+      mask(juce::uint32(cells.size() - 1)),
+      head(0), tail(0)
+{
+    for (juce::uint32 i = 0; i < cells.size(); i++)
+        cells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+bool ParamEventQueue::push(const Event& e)
+{
+    juce::uint32 pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& c = cells[pos & mask];
+        juce::uint32 seq = c.seq.load(std::memory_order_acquire);
+        juce::int32 dif = juce::int32(seq - pos);
+        if (dif == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return false;   // full
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    Cell& c = cells[pos & mask];
+    c.e = e;
+    c.seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool ParamEventQueue::pop(Event& e)
+{
+    Cell& c = cells[tail & mask];
+    if (juce::int32(c.seq.load(std::memory_order_acquire) - (tail + 1)) < 0)
+        return false;
+    e = c.e;
+    c.seq.store(tail + mask + 1, std::memory_order_release);
+    tail++;
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+namespace gx_engine { class Parameter; }
+
+//==============================================================================
+/*
+** Bounded lock-free queue of parameter values, any number of writers and
+** one reader.
+**
+** Host automation and GUI changes arrive on whatever thread the host
+** uses; they are pushed here and taken over by the audio thread at the
+** start of the next block, so the engine parameters are only written
+** between quanta. Every cell carries a sequence number telling writers
+** and the reader whose turn it is (D. Vyukov's bounded queue), a push
+** never waits for a slow reader and fails when the queue is full.
+*/
+class ParamEventQueue
+{
+public:
+    struct Event
+    {
+        gx_engine::Parameter *param;
+        float value;        // in parameter units
+        bool right;         // parameter of the right machine
+    };
+
+    // capacity is rounded up to a power of two
+    explicit ParamEventQueue(int capacity = 1024);
+
+    bool push(const Event& e);
+    // reader only
+    bool pop(Event& e);
+
+private:
+    struct Cell
+    {
+        std::atomic<juce::uint32> seq;
+        Event e;
+    };
+    std::vector<Cell> cells;
+    juce::uint32 mask;
+    std::atomic<juce::uint32> head;
+    juce::uint32 tail;
+
+    JUCE_DECLARE_NON_COPYABLE (ParamEventQueue)
+};
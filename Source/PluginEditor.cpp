@@ -20,9 +20,16 @@
 #include "GuitarixEditor.h"
 
 #include "JuceUiBuilder.h"
+#include "UiDescription.h"
+#include <map>
 
 using namespace juce;
 
+// heights of the units built so far, shared by all editors of the process
+static std::map<std::string, int> unit_heights;
+// for a unit that wasn't built yet, about a row of knobs
+static const int guessed_height = knobh + 2 * texth;
+
 void cat2color(const char* cat, juce::Colour &col)
 {
     if(strcmp(cat, "Tone Control")==0)
@@ -48,7 +55,7 @@ void cat2color(const char* cat, juce::Colour &col)
 
 //==============================================================================
 PluginEditor::PluginEditor(MachineEditor* ed, const char* id, const char* cat, PluginSelector *ps) :
-    ed(ed), pid(id), ps(ps), cat(cat),
+    ed(ed), pid(id), ps(ps), cat(cat), built(false), collapsedSince(0),
     lastIRDirectory(juce::File::getSpecialLocation(juce::File::userMusicDirectory)),
     lastRTNeuralDirectory(juce::File::getSpecialLocation(juce::File::userMusicDirectory)),
     lastNAMDirectory(juce::File::getSpecialLocation(juce::File::userMusicDirectory))
@@ -74,18 +81,54 @@ void PluginEditor::recreate(const char *id, const char *cat, int edx, int edy, i
     cat2color(cat, col);
     col = col.withAlpha((uint8)30);
     create(edx, edy, w, h);
+    // the panel of a newly selected unit is expanded right away
+    if (pid.length() != 0)
+    {
+        build(w, h);
+        setBounds(edx, edy, w, h);
+    }
     repaint();
 }
 
 void PluginEditor::create(int edx, int edy, int &w, int &h)
 {
-    if (pid.length() == 0)
+    w = edtw;
+    h = 0;
+    if (pid.length() != 0)
     {
-        w = edtw;
-        h = 0;
-        setBounds(edx, edy, w, h);
-        return;
+        auto i = unit_heights.find(pid);
+        h = i != unit_heights.end() ? i->second : guessed_height;
+    }
+    // the widgets follow in resized() when the panel gets a height
+    setBounds(edx, edy, w, 0);
+}
+
+void PluginEditor::resized()
+{
+    if (getHeight() > 0)
+    {
+        collapsedSince = 0;
+        if (!built && pid.length() != 0)
+        {
+            int w, h;
+            build(w, h);
+        }
+    }
+    else if (built && collapsedSince == 0)
+    {
+        collapsedSince = juce::jmax(juce::Time::getMillisecondCounter(), juce::uint32(1));
     }
+}
+
+void PluginEditor::release_if_collapsed(juce::uint32 now)
+{
+    if (built && collapsedSince != 0 && getHeight() == 0 && now - collapsedSince >= juce::uint32(release_ms))
+        clear();
+}
+
+void PluginEditor::build(int &w, int &h)
+{
+    built = true;
     //ed->registerParListener(this);
     const char *id = pid.c_str();
 
@@ -376,12 +419,13 @@ void PluginEditor::create(int edx, int edy, int &w, int &h)
         set_rtneural_load_button_text("rtneural.", true);
     }
     else {
-        pd->load_ui(b, UI_FORM_STACK);
+        // usually recorded in the background when the rack was set up
+        ui = UiDescription::get(ed->machine, pd);
+        ui->replay(b);
     }
 
     w = rect.getWidth(); 
     h = rect.getHeight()+2;
-    setBounds(edx, edy, w, h);
     //ed->addAndMakeVisible(this);
     //ScalableEQ needs to be reduced a bit to fit into rack size
     if (pid == "eqs") {
@@ -389,6 +433,12 @@ void PluginEditor::create(int edx, int edy, int &w, int &h)
             this->getChildComponent(i)->setTransform(AffineTransform::scale(0.82));
         }
     }
+    auto& known = unit_heights[pid];
+    if (known != h)
+    {
+        known = h;
+        ed->setEditorHeight(this, h);
+    }
 }
 
 bool PluginEditor::is_factory_IR(const std::string& dir) {
@@ -503,11 +553,16 @@ void PluginEditor::clear()
         delete (*i);
     }
     edlist.clear();
+    ui.reset();
+    built = false;
+    collapsedSince = 0;
 }
 
 void PluginEditor::subscribe_timer(std::string id)
 {
-    ed->clist.push_back(id);
+    // again when the unit is built again
+    if (std::find(ed->clist.begin(), ed->clist.end(), id) == ed->clist.end())
+        ed->clist.push_back(id);
 }
 
 void PluginEditor::getinfo(std::string &text)
@@ -570,17 +625,16 @@ void PluginEditor::load_RTNeural(const std::string& attr, juce::Button* button,
     gx_engine::ParamMap& param = ed->get_param();
     if (param.hasId(attr)) {
         gx_engine::Parameter& p = param[attr];
-        ed->SetAlternateDouble(ModifierKeys::getCurrentModifiers().testFlags(ModifierKeys::shiftModifier));
-        p.set_blocked(true);
-        
         if (dynamic_cast<gx_engine::StringParameter*>(&p))
         {
-            std::string filename = fname.toStdString();
-            ed->machine->set_parameter_value(attr, filename);
-            set_rtneural_load_button_text(attr, true);
+            // the model is built in the background, the button shows
+            // the running model again when it is done
+            juce::Component::SafePointer<PluginEditor> self(this);
+            button->setButtonText(juce::File(fname).getFileNameWithoutExtension());
+            ed->load_model(attr, fname.toStdString(),
+                [self, attr] { if (self) self->set_rtneural_load_button_text(attr, true); },
+                ModifierKeys::getCurrentModifiers().testFlags(ModifierKeys::shiftModifier));
         }
-        p.set_blocked(false);
-        ed->SetAlternateDouble(false);
     }    
 }
 
@@ -609,17 +663,15 @@ void PluginEditor::load_NAM(const std::string& attr, juce::Button* button, juce:
     gx_engine::ParamMap& param = ed->get_param();
     if (param.hasId(attr)) {
         gx_engine::Parameter& p = param[attr];
-        ed->SetAlternateDouble(ModifierKeys::getCurrentModifiers().testFlags(ModifierKeys::shiftModifier));
-        p.set_blocked(true);
-        
         if (dynamic_cast<gx_engine::StringParameter*>(&p))
         {
-            std::string filename = fname.toStdString();
-            ed->machine->set_parameter_value(attr, filename);
-            set_nam_load_button_text(attr, true);
+            // see load_RTNeural
+            juce::Component::SafePointer<PluginEditor> self(this);
+            button->setButtonText(juce::File(fname).getFileNameWithoutExtension());
+            ed->load_model(attr, fname.toStdString(),
+                [self, attr] { if (self) self->set_nam_load_button_text(attr, true); },
+                ModifierKeys::getCurrentModifiers().testFlags(ModifierKeys::shiftModifier));
         }
-        p.set_blocked(false);
-        ed->SetAlternateDouble(false);
     }    
 }
 
@@ -1016,6 +1068,19 @@ void PluginSelector::paint(juce::Graphics& g)
     else if(pid == "tuner")
         g.drawFittedText("Tuner", rect, Justification::verticallyCentred | Justification::left, 1);
 
+    RackUnitMonitor::UnitTiming t;
+    if (ed->get_unit_timing(pid.c_str(), t))
+    {
+        // average / worst time per block
+        rect = getLocalBounds();
+        rect.setX(texth + 8 + 250 + 4 + (stereo ? 64 : 0));
+        rect.setRight(edtw - 2 * (texth + 4) - 4);
+        g.setFont(12.0f);
+        g.setColour(juce::Colours::white);
+        g.drawFittedText(juce::String(t.avg_us, 1) + " / " + juce::String(t.worst_us, 1) + " us",
+                         rect, Justification::verticallyCentred | Justification::right, 1);
+    }
+
     g.setColour(juce::Colour(0x7fffffff));
     rect = getLocalBounds();
     g.drawLine(0,1,rect.getWidth(),1);
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <memory>
 
 namespace gx_engine { class Parameter; class GxMachine; }
 namespace gx_system { class CmdlineOptions; }
@@ -26,6 +27,7 @@ namespace gx_system { class CmdlineOptions; }
 //==============================================================================
 class MachineEditor;
 class PluginSelector;
+class UiDescription;
 
 class MuteButton : public juce::ToggleButton
 {
@@ -95,6 +97,11 @@ public:
 	virtual void on_param_value_changed(gx_engine::Parameter *p)=0;
 };
 
+// The widgets of a rack unit are built when its panel is first shown
+// (has a height), create() only sets up the size. The height of a unit is
+// known after it was built once, until then the panel gets a guess that is
+// corrected afterwards. Widgets of a panel that stayed collapsed for
+// release_ms are deleted again, only the header stays.
 class PluginEditor: public juce::Component,
 	public juce::Slider::Listener,
 	public juce::Button::Listener,
@@ -105,10 +112,13 @@ public:
 	PluginEditor(MachineEditor* ed, const char* id, const char* cat, PluginSelector *ps = 0);
 	virtual ~PluginEditor() { clear(); }
 
+	static const int release_ms = 30000;
+
 	//MachineEditor callbacks
 	void create(int edx, int edy, int &w, int &h);
 	void recreate(const char *id, const char *cat, int edx, int edy, int &w, int &h);
 	void clear();
+	void release_if_collapsed(juce::uint32 now);
 	void getinfo(std::string &text);
 	PluginSelector* getPluginSelector() { return ps; }
 
@@ -129,6 +139,8 @@ public:
     gx_system::CmdlineOptions& get_options();
 
 private:
+	void build(int &w, int &h);
+	void resized() override;
 	void sliderValueChanged(juce::Slider* slider) override;
 	void buttonClicked(juce::Button* button) override;
 	void comboBoxChanged(juce::ComboBox* combo) override;
@@ -148,6 +160,10 @@ private:
 	void paint(juce::Graphics& g) override;
     juce::Component* findChildByID(juce::Component* parent, const std::string parid);
 	std::list<juce::Component*> edlist;
+	// the widgets keep pointers to its ids
+	std::shared_ptr<const UiDescription> ui;
+	bool built;
+	juce::uint32 collapsedSince;
 	
 	MachineEditor *ed;
 	PluginSelector *ps;
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "PresetSaver.h"
+#include "BankIndex.h"
+
+PresetSaver::PresetSaver()
+    : juce::Thread("preset save"), pending(0), alive(std::make_shared<bool>(true))
+{
+}
+
+PresetSaver::~PresetSaver()
+{
+    alive.reset();
+    // the queued presets are still written
+    while (isThreadRunning() && pending.load() > 0)
+        juce::Thread::sleep(5);
+    signalThreadShouldExit();
+    wakeup.signal();
+    stopThread(5000);
+}
+
+void PresetSaver::save(Job job)
+{
+    {
+        const juce::ScopedLock lock(cs);
+        writing[job.bank.getFullPathName()]++;
+        jobs.push_back(std::move(job));
+        pending++;
+    }
+    if (!isThreadRunning())
+        startThread();
+    wakeup.signal();
+}
+
+void PresetSaver::run()
+{
+    while (!threadShouldExit()) {
+        Job job;
+        {
+            const juce::ScopedLock lock(cs);
+            if (!jobs.empty()) {
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+        }
+        if (!job.done) {
+            wakeup.wait(500);
+            continue;
+        }
+        std::string_view body;
+        bool ok = get_current_preset(job.state, body) && write_preset(job.bank, job.name, body);
+        {
+            const juce::ScopedLock lock(cs);
+            auto i = writing.find(job.bank.getFullPathName());
+            if (i != writing.end() && --i->second == 0)
+                writing.erase(i);
+        }
+        written.signal();
+        std::weak_ptr<bool> token = alive;
+        auto done = std::move(job.done);
+        juce::MessageManager::callAsync([token, done, ok] {
+            if (token.lock())
+                done(ok);
+        });
+        pending--;
+    }
+}
+
+bool PresetSaver::is_writing(const juce::File& bank) const
+{
+    const juce::ScopedLock lock(cs);
+    return writing.count(bank.getFullPathName()) > 0;
+}
+
+void PresetSaver::wait_for(const juce::File& bank)
+{
+    while (is_writing(bank))
+        written.wait(50);
+}
+
+bool PresetSaver::get_current_preset(const std::string& state, std::string_view& body)
+{
+    std::vector<BankIndex::Entry> entries;
+    if (!BankIndex::scan(state.data(), state.size(), entries))
+        return false;
+    for (auto& e : entries) {
+        if (e.name == "current_preset") {
+            body = std::string_view(state.data() + e.offset, size_t(e.length));
+            return body.size() > 1 && body[0] == '{';
+        }
+    }
+    return false;
+}
+
+static void write_json_string(juce::OutputStream& out, const std::string& s)
+{
+    out << "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out.writeByte('\\');
+            out.writeByte(char(c));
+        } else if (c < 0x20) {
+            out << "\\u" << juce::String::toHexString(int(c)).paddedLeft('0', 4);
+        } else {
+            out.writeByte(char(c));
+        }
+    }
+    out << "\"";
+}
+
+bool PresetSaver::write_preset(const juce::File& bank, const std::string& name, std::string_view body)
+{
+    juce::MemoryBlock mb;
+    if (!bank.loadFileAsData(mb))
+        return false;
+    const char *data = static_cast<const char*>(mb.getData());
+    std::vector<BankIndex::Entry> entries;
+    size_t header = 0;
+    if (!BankIndex::scan(data, mb.getSize(), entries, &header))
+        return false;
+
+    juce::TemporaryFile tmp(bank);
+    {
+        juce::FileOutputStream out(tmp.getFile());
+        if (!out.openedOk())
+            return false;
+        out.write(data, header);
+        bool replaced = false;
+        for (auto& e : entries) {
+            out << ",\n";
+            write_json_string(out, e.name);
+            out << ", ";
+            if (e.name == name && !replaced) {
+                out.write(body.data(), body.size());
+                replaced = true;
+            } else {
+                out.write(data + e.offset, size_t(e.length));
+            }
+        }
+        if (!replaced) {
+            out << ",\n";
+            write_json_string(out, name);
+            out << ", ";
+            out.write(body.data(), body.size());
+        }
+        out << "\n]\n";
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+    return tmp.overwriteTargetFileWithTemporary();
+}
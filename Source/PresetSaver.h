@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+//==============================================================================
+/*
+** Writes presets into bank files on its own thread.
+**
+** The message thread hands over a snapshot of the engine state as
+** saveState() writes it; the thread takes its "current_preset" object,
+** puts it into the bank under the preset name (replacing a preset of that
+** name, else appended), writes the bank to a temporary file next to it
+** and renames that over the bank. done(ok) is called on the message
+** thread afterwards, ok is false when the snapshot or the bank couldn't
+** be used and nothing was written.
+**
+** Jobs run one after the other in the order they were given. The
+** destructor waits for the queued ones, their done callbacks aren't
+** called any more.
+**
+** The engine's PresetFile keeps offsets into the bank, which are stale
+** until it reparses the file. Before the message thread reads or writes
+** a bank itself it calls wait_for(), which returns once the jobs for that
+** bank are written, and reparses it.
+*/
+class PresetSaver : private juce::Thread
+{
+public:
+    struct Job
+    {
+        juce::File bank;
+        std::string name;
+        std::string state;
+        std::function<void(bool ok)> done;
+    };
+
+    PresetSaver();
+    ~PresetSaver() override;
+
+    void save(Job job);
+    bool is_busy() const { return pending.load() > 0; }
+    // true when jobs for bank are queued or running
+    bool is_writing(const juce::File& bank) const;
+    // waits until the jobs for bank are written, message thread
+    void wait_for(const juce::File& bank);
+
+    // splices body into the bank file under name
+    static bool write_preset(const juce::File& bank, const std::string& name, std::string_view body);
+    // the "current_preset" object of a saved state
+    static bool get_current_preset(const std::string& state, std::string_view& body);
+
+private:
+    void run() override;
+
+    juce::CriticalSection cs;
+    std::deque<Job> jobs;
+    std::map<juce::String, int> writing;   // jobs not yet written, by bank path
+    std::atomic<int> pending;
+    juce::WaitableEvent wakeup, written;
+    std::shared_ptr<bool> alive;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PresetSaver)
+};
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+** procbench: runs GuitarixProcessor without editor and host.
+**
+**   procbench [-b blocksize,...] [-r rate] [-s seconds] [-i input.wav]
+**             [-p [bank:]preset] [-B bankfile.gx] [-c state]
+**             [-t trace.json] [-o result.json] [-a]
+**
+** The input is a wav file or a synthetic plucked string. Every block size
+** (non power of two sizes go through the quantum ring) is run on the same
+** processor and reported as one JSON document: real-time factor
+** (processing time / audio time), block time percentiles against the
+** deadline and heap allocations per block: C++ new only, all of malloc in
+** an RT_CHECK build ("allocations_counted" says which). -c loads a state chunk as saved
+** by the host, -B/-p a preset from a bank file or a bank of the guitarix
+** config, -t saves the telemetry trace of the run.
+**
+** Built with RT_CHECK=1 every result also lists the malloc, free and
+** mutex lock call sites hit inside processBlock after the warmup, and -a
+** makes procbench exit with status 2 when there were any.
+*/
+
+#include <JuceHeader.h>
+#include "GuitarixProcessor.h"
+#include "guitarix.h"       // NOLINT
+#include "RtSafetyCheck.h"
+#include <chrono>
+#include <random>
+
+//==============================================================================
+// counts operator new on the thread inside processBlock, C code and
+// plugins that call malloc directly are only seen by the RT_CHECK hooks
+
+static thread_local bool in_block = false;
+static std::atomic<juce::uint64> block_allocs { 0 };
+
+void *operator new(size_t n)
+{
+    if (in_block) block_allocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+//==============================================================================
+
+// a plucked string (Karplus-Strong), three seconds of notes and one of
+// silence, so idle skipping and the noise gate take part
+static void synth_input(std::vector<float>& out, int rate)
+{
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> note(40, 76);
+    std::vector<float> delay;
+    size_t pos = 0;
+    for (size_t i = 0; i < out.size(); i++) {
+        double t = double(i) / rate;
+        double cycle = std::fmod(t, 4.0);
+        if (cycle >= 3.0) {
+            out[i] = 0.0f;
+            delay.clear();
+            continue;
+        }
+        if (std::fmod(cycle, 0.375) < 1.0 / rate) {
+            double f = 440.0 * std::pow(2.0, (note(rng) - 69) / 12.0);
+            delay.resize(std::max<size_t>(2, size_t(rate / f)));
+            for (auto& s : delay) s = 0.3f * noise(rng);
+            pos = 0;
+        }
+        if (delay.empty()) {
+            out[i] = 0.0f;
+            continue;
+        }
+        size_t next = (pos + 1) % delay.size();
+        float y = delay[pos];
+        delay[pos] = 0.498f * (delay[pos] + delay[next]);
+        pos = next;
+        out[i] = y;
+    }
+}
+
+static bool load_wav(const juce::File& f, std::vector<float> in[2], int& rate)
+{
+    juce::AudioFormatManager fm;
+    fm.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> r(fm.createReaderFor(f));
+    if (!r) return false;
+    juce::AudioBuffer<float> b(2, int(r->lengthInSamples));
+    r->read(&b, 0, int(r->lengthInSamples), 0, true, true);
+    for (int c = 0; c < 2; c++)
+        in[c].assign(b.getReadPointer(c), b.getReadPointer(c) + b.getNumSamples());
+    rate = int(r->sampleRate);
+    return true;
+}
+
+static bool load_bank_file(GuitarixProcessor& p, const juce::File& f, const juce::String& preset)
+{
+    gx_jack::GxJack *jack;
+    gx_engine::GxMachine *machine;
+    p.get_machine_jack(jack, machine, false);
+    gx_system::PresetFile pf;
+    if (!pf.open_file(f.getFileNameWithoutExtension().toStdString(), f.getFullPathName().toStdString(),
+                      gx_system::PresetFile::PRESET_FILE, 0))
+        return false;
+    if (!pf.has_entry(preset.toStdString()))
+        return false;
+    machine->load_preset(pf.get_guiwrapper(), preset.toStdString());
+    return true;
+}
+
+// lets timers, async calls and the IR and model threads catch up
+static void settle(int ms)
+{
+    juce::MessageManager::getInstance()->runDispatchLoopUntil(ms);
+}
+
+static double percentile(const std::vector<double>& sorted, double q)
+{
+    if (sorted.empty()) return 0.0;
+    return sorted[std::min(sorted.size() - 1, size_t(q * sorted.size()))];
+}
+
+static juce::var run(GuitarixProcessor& p, const std::vector<float> in[2], int rate, int bs, double warmup)
+{
+    p.setPlayConfigDetails(2, 2, rate, bs);
+    p.prepareToPlay(rate, bs);
+    settle(200);
+
+    juce::DynamicObject::Ptr r = new juce::DynamicObject();
+    r->setProperty("block_size", bs);
+    size_t len = in[0].size();
+    if (len < size_t(bs)) {
+        r->setProperty("error", "input shorter than one block");
+        return juce::var(r.get());
+    }
+
+    juce::AudioBuffer<float> buffer(2, bs);
+    juce::MidiBuffer midi;
+    std::vector<double> times;
+    times.reserve(len / bs + 1);
+    juce::uint64 allocs = 0;
+    double total = 0.0;
+    size_t nwarm = size_t(warmup * rate) / bs;
+    size_t nblocks = len / bs;
+    for (size_t b = 0; b < nwarm + nblocks; b++) {
+        size_t pos = (b * bs) % (len - bs + 1);
+        for (int c = 0; c < 2; c++)
+            buffer.copyFrom(c, 0, in[c].data() + pos, bs);
+        if (b == nwarm)
+            rt_check::reset();
+        block_allocs.store(0, std::memory_order_relaxed);
+        in_block = true;
+        auto t0 = std::chrono::steady_clock::now();
+        p.processBlock(buffer, midi);
+        auto t1 = std::chrono::steady_clock::now();
+        in_block = false;
+        // the telemetry refresh task does not run between blocks here
+        if ((b & 511) == 511)
+            p.get_telemetry().collect();
+        if (b < nwarm) continue;
+        double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        times.push_back(us);
+        total += us;
+        allocs += block_allocs.load(std::memory_order_relaxed);
+    }
+    std::sort(times.begin(), times.end());
+    double deadline = 1e6 * bs / rate;
+    int over = int(times.end() - std::upper_bound(times.begin(), times.end(), deadline));
+
+    juce::DynamicObject::Ptr lat = new juce::DynamicObject();
+    lat->setProperty("p50", percentile(times, 0.5));
+    lat->setProperty("p90", percentile(times, 0.9));
+    lat->setProperty("p99", percentile(times, 0.99));
+    lat->setProperty("p999", percentile(times, 0.999));
+    lat->setProperty("max", times.empty() ? 0.0 : times.back());
+
+    r->setProperty("power_of_two", (bs & (bs - 1)) == 0);
+    r->setProperty("blocks", int(times.size()));
+    r->setProperty("rtf", times.empty() ? 0.0 : total / (deadline * times.size()));
+    r->setProperty("deadline_us", deadline);
+    r->setProperty("block_us", juce::var(lat.get()));
+    r->setProperty("over_deadline", over);
+    // the hooks were reset at the end of the warmup
+    if (rt_check::available())
+        allocs = rt_check::get_total(rt_check::kind_malloc);
+    r->setProperty("allocations_counted", rt_check::available() ? "malloc" : "C++ new only");
+    r->setProperty("allocations", juce::int64(allocs));
+    r->setProperty("allocations_per_block", times.empty() ? 0.0 : double(allocs) / times.size());
+    r->setProperty("plugin_latency", p.getLatencySamples());
+    if (rt_check::available()) {
+        juce::Array<juce::var> sites;
+        for (auto& site : rt_check::get_sites()) {
+            juce::DynamicObject::Ptr o = new juce::DynamicObject();
+            o->setProperty("kind", rt_check::get_kind_name(site.kind));
+            o->setProperty("count", juce::int64(site.count));
+            juce::Array<juce::var> stack;
+            for (auto& f : site.stack)
+                stack.add(f);
+            o->setProperty("stack", stack);
+            sites.add(juce::var(o.get()));
+        }
+        juce::DynamicObject::Ptr v = new juce::DynamicObject();
+        for (int k = 0; k < rt_check::num_kinds; k++)
+            v->setProperty(rt_check::get_kind_name(rt_check::Kind(k)),
+                           juce::int64(rt_check::get_total(rt_check::Kind(k))));
+        v->setProperty("sites", sites);
+        r->setProperty("rt_violations", juce::var(v.get()));
+    }
+    return juce::var(r.get());
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> blocksizes;
+    int rate = 0;
+    double seconds = 10.0, warmup = 1.0;
+    juce::String input, preset, bankfile, state, trace, output;
+    bool fail_on_violation = false;
+    auto cwd = juce::File::getCurrentWorkingDirectory();
+    for (int i = 1; i < argc; i++) {
+        juce::String a(argv[i]);
+        bool arg = i + 1 < argc;
+        if (a == "-b" && arg) {
+            for (auto& s : juce::StringArray::fromTokens(argv[++i], ",", ""))
+                if (s.getIntValue() > 0) blocksizes.push_back(s.getIntValue());
+        }
+        else if (a == "-r" && arg) rate = atoi(argv[++i]);
+        else if (a == "-s" && arg) seconds = atof(argv[++i]);
+        else if (a == "-w" && arg) warmup = atof(argv[++i]);
+        else if (a == "-i" && arg) input = argv[++i];
+        else if (a == "-p" && arg) preset = argv[++i];
+        else if (a == "-B" && arg) bankfile = argv[++i];
+        else if (a == "-c" && arg) state = argv[++i];
+        else if (a == "-t" && arg) trace = argv[++i];
+        else if (a == "-o" && arg) output = argv[++i];
+        else if (a == "-a") fail_on_violation = true;
+        else {
+            fprintf(stderr, "usage: %s [-b blocksize,...] [-r rate] [-s seconds] [-w warmup] [-i input.wav]\n"
+                            "       [-p [bank:]preset] [-B bankfile.gx] [-c state] [-t trace.json] [-o result.json] [-a]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (blocksizes.empty()) blocksizes = { 64, 128, 256, 96, 300 };
+
+    juce::ScopedJuceInitialiser_GUI juce_init;
+
+    std::vector<float> in[2];
+    if (input.isNotEmpty()) {
+        int wav_rate = 0;
+        if (!load_wav(cwd.getChildFile(input), in, wav_rate)) {
+            fprintf(stderr, "can't read %s\n", input.toRawUTF8());
+            return 1;
+        }
+        if (!rate) rate = wav_rate;
+    } else {
+        if (!rate) rate = 48000;
+        in[0].resize(size_t(seconds * rate));
+        synth_input(in[0], rate);
+        in[1] = in[0];
+    }
+    int maxbs = *std::max_element(blocksizes.begin(), blocksizes.end());
+    if (in[0].size() < size_t(maxbs)) {
+        fprintf(stderr, "input shorter than one block of %d\n", maxbs);
+        return 1;
+    }
+
+    std::unique_ptr<GuitarixProcessor> p(new GuitarixProcessor());
+    p->setPlayConfigDetails(2, 2, rate, blocksizes.front());
+    p->prepareToPlay(rate, blocksizes.front());
+    settle(500);
+
+    if (state.isNotEmpty()) {
+        juce::MemoryBlock mb;
+        if (!cwd.getChildFile(state).loadFileAsData(mb)) {
+            fprintf(stderr, "can't read %s\n", state.toRawUTF8());
+            return 1;
+        }
+        p->setStateInformation(mb.getData(), int(mb.getSize()));
+    } else if (bankfile.isNotEmpty()) {
+        if (!load_bank_file(*p, cwd.getChildFile(bankfile), preset)) {
+            fprintf(stderr, "can't load preset '%s' from %s\n", preset.toRawUTF8(), bankfile.toRawUTF8());
+            return 1;
+        }
+    } else if (preset.isNotEmpty()) {
+        gx_jack::GxJack *jack;
+        gx_engine::GxMachine *machine;
+        p->get_machine_jack(jack, machine, false);
+        std::string bank = machine->get_settings().get_current_bank(), name = preset.toStdString();
+        if (preset.containsChar(':')) {
+            bank = preset.upToFirstOccurrenceOf(":", false, false).toStdString();
+            name = preset.fromFirstOccurrenceOf(":", false, false).toStdString();
+        }
+        p->load_preset(bank, name);
+    }
+    // IRs and models of the preset are loaded in the background
+    settle(1000);
+
+    juce::Array<juce::var> results;
+    juce::uint64 violations = 0;
+    for (int bs : blocksizes) {
+        results.add(run(*p, in, rate, bs, warmup));
+        for (int k = 0; k < rt_check::num_kinds; k++)
+            violations += rt_check::get_total(rt_check::Kind(k));
+    }
+    p->releaseResources();
+
+    juce::DynamicObject::Ptr doc = new juce::DynamicObject();
+    doc->setProperty("input", input.isNotEmpty() ? input : juce::String("synthetic"));
+    doc->setProperty("preset", state.isNotEmpty() ? state : (bankfile.isNotEmpty() ? bankfile + ":" + preset : preset));
+    doc->setProperty("rate", rate);
+    doc->setProperty("seconds", double(in[0].size()) / rate);
+    doc->setProperty("cpus", juce::SystemStats::getNumCpus());
+    doc->setProperty("telemetry", p->get_telemetry().get_summary());
+    doc->setProperty("results", results);
+    if (trace.isNotEmpty())
+        p->get_telemetry().write_trace(cwd.getChildFile(trace));
+    p.reset();
+
+    juce::String json = juce::JSON::toString(juce::var(doc.get()));
+    if (output.isNotEmpty()) {
+        if (!cwd.getChildFile(output).replaceWithText(json + "\n")) {
+            fprintf(stderr, "can't write %s\n", output.toRawUTF8());
+            return 1;
+        }
+    } else
+        printf("%s\n", json.toRawUTF8());
+    if (violations)
+        fprintf(stderr, "%llu realtime violations inside processBlock\n", (unsigned long long)violations);
+    return fail_on_violation && violations ? 2 : 0;
+}
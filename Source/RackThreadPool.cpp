@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "RackThreadPool.h"
+#include "RtSafetyCheck.h"
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+#if JUCE_LINUX
+ #include <linux/futex.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+static inline void spin_pause()
+{
+#if JUCE_INTEL
+    _mm_pause();
+#elif JUCE_ARM && (defined(__GNUC__) || defined(__clang__))
+    __asm__ __volatile__ ("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// spin iterations before the audio thread starts yielding in wait_done(),
+// and how long a helper spins for the next block before it sleeps
+static const int spin_count = 1 << 14;
+static const double helper_spin_us = 50.0;
+
+//==============================================================================
+// wakes a sleeping helper without taking a mutex on the audio thread: on
+// Linux signal() is one FUTEX_WAKE system call, which never blocks
+class Wake
+{
+public:
+#if JUCE_LINUX
+    Wake() : word(0) {}
+
+    void signal()
+    {
+        word.store(1, std::memory_order_release);
+        syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    // returns early for a signal() that came before, a stale one only
+    // causes a spurious wake-up
+    void wait(int ms)
+    {
+        if (word.exchange(0, std::memory_order_acquire)) return;
+        struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+        syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, 0, &ts, nullptr, 0);
+        word.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int> word;
+#else
+    // elsewhere the event's mutex is taken by post() when a helper sleeps
+    void signal() { event.signal(); }
+    void wait(int ms) { event.wait(ms); }
+
+private:
+    juce::WaitableEvent event;
+#endif
+};
+
+//==============================================================================
+class RackThreadPool::Worker : public juce::Thread
+{
+public:
+    explicit Worker(int i)
+        : juce::Thread("guitarix rack " + juce::String(i)),
+          fn(nullptr), arg(nullptr), seq(0), handled(0), done(true), sleeping(false) {}
+
+    void post(const Task& t)
+    {
+        fn = t.fn;
+        arg = t.arg;
+        done.store(false, std::memory_order_relaxed);
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst)) wake.signal();
+    }
+
+    void wait_done() const
+    {
+        for (int spins = 0; !done.load(std::memory_order_acquire); spins++) {
+            if (spins < spin_count) spin_pause();
+            else juce::Thread::yield();
+        }
+    }
+
+    void shutdown()
+    {
+        signalThreadShouldExit();
+        wake.signal();
+        stopThread(1000);
+    }
+
+    void run() override
+    {
+        juce::FloatVectorOperations::disableDenormalisedNumberSupport();
+        while (!threadShouldExit())
+        {
+            juce::uint32 s;
+            // a realtime helper that yields only gives way to threads of
+            // its own priority, so it spins briefly and then sleeps
+            juce::int64 spin_until = juce::Time::getHighResolutionTicks()
+                + juce::Time::secondsToHighResolutionTicks(helper_spin_us * 1e-6);
+            while ((s = seq.load(std::memory_order_acquire)) == handled)
+            {
+                if (threadShouldExit()) return;
+                if (juce::Time::getHighResolutionTicks() < spin_until) {
+                    spin_pause();
+                } else {
+                    sleeping.store(true, std::memory_order_seq_cst);
+                    if (seq.load(std::memory_order_seq_cst) == handled) wake.wait(100);
+                    sleeping.store(false, std::memory_order_relaxed);
+                }
+            }
+            handled = s;
+            {
+            // the task is part of the audio thread's block
+            const rt_check::Scope rtCheck;
+            fn(arg);
+            }
+            done.store(true, std::memory_order_release);
+        }
+    }
+
+private:
+    TaskFn fn;
+    void *arg;
+    std::atomic<juce::uint32> seq;
+    // last seq taken by the helper, so a post() that comes
+    // before the thread got going is not lost
+    juce::uint32 handled;
+    std::atomic<bool> done;
+    std::atomic<bool> sleeping;
+    Wake wake;
+};
+
+//==============================================================================
+RackThreadPool::RackThreadPool(int helpers)
+    : running(false), in_run(0)
+{
+    // a helper sharing the only core with the audio thread just adds latency
+    helpers = std::min(helpers, juce::SystemStats::getNumCpus() - 1);
+    for (int i = 0; i < helpers; i++)
+        workers.add(new Worker(i + 1));
+}
+
+RackThreadPool::~RackThreadPool()
+{
+    stop();
+}
+
+void RackThreadPool::start()
+{
+    juce::Thread::RealtimeOptions opt;
+    opt.priority = 8;
+    for (auto w : workers) {
+        if (w->isThreadRunning()) continue;
+        // realtime scheduling needs the rights the host's audio thread has,
+        // fall back to a plain thread otherwise
+        if (!w->startRealtimeThread(opt))
+            w->startThread(juce::Thread::Priority::highest);
+    }
+    running.store(true, std::memory_order_seq_cst);
+}
+
+void RackThreadPool::set_affinity(int first_cpu)
+{
+    int ncpus = std::min(juce::SystemStats::getNumCpus(), 32);
+    for (int i = 0; i < workers.size(); i++)
+        workers[i]->setAffinityMask(juce::uint32(1) << ((first_cpu + i) % ncpus));
+}
+
+void RackThreadPool::stop()
+{
+    // a run() that got the helpers waits for them, the ones that come
+    // later run everything on the calling thread
+    running.store(false, std::memory_order_seq_cst);
+    while (in_run.load(std::memory_order_seq_cst) > 0)
+        juce::Thread::yield();
+    for (auto w : workers)
+        w->shutdown();
+}
+
+void RackThreadPool::run(const Task *tasks, int count)
+{
+    // pairs with stop(): either it sees in_run or we see it stopping
+    bool helpers = false;
+    if (running.load(std::memory_order_seq_cst)) {
+        in_run.fetch_add(1, std::memory_order_seq_cst);
+        helpers = running.load(std::memory_order_seq_cst);
+        if (!helpers) in_run.fetch_sub(1, std::memory_order_seq_cst);
+    }
+    int posted = 0;
+    for (int i = 1; helpers && i < count && posted < workers.size(); i++) {
+        if (!workers[posted]->isThreadRunning()) break;
+        workers[posted++]->post(tasks[i]);
+    }
+    tasks[0].fn(tasks[0].arg);
+    for (int i = posted + 1; i < count; i++)
+        tasks[i].fn(tasks[i].arg);
+    for (int i = 0; i < posted; i++)
+        workers[i]->wait_done();
+    if (helpers) in_run.fetch_sub(1, std::memory_order_seq_cst);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/*
+** A few realtime helper threads for running independent rack chains of one
+** block side by side.
+**
+** run() is called from the audio thread. It hands all but the first task
+** to the helpers, executes the first one itself and spins until the others
+** are done, so a block takes as long as its slowest chain. Helpers spin for
+** a few microseconds after each task, in case run() posts again right
+** away, and then sleep until the next post().
+** Waking a sleeping helper is a futex call on Linux, the audio thread
+** never waits for a mutex.
+**
+** Until start() and after stop() run() executes all tasks on the calling
+** thread, stop() may be called while an audio thread is in run().
+*/
+class RackThreadPool
+{
+public:
+    typedef void (*TaskFn)(void *arg);
+    struct Task
+    {
+        TaskFn fn;
+        void *arg;
+    };
+
+    explicit RackThreadPool(int helpers = 1);
+    ~RackThreadPool();
+
+    void start();
+    void stop();
+    int get_num_helpers() const { return workers.size(); }
+    // pins helper i to core first_cpu + i (wrapping around), takes
+    // effect with the next start()
+    void set_affinity(int first_cpu);
+
+    // returns when all count tasks have finished, tasks beyond the
+    // number of helpers (none on single core machines) run on the
+    // calling thread
+    void run(const Task *tasks, int count);
+
+private:
+    class Worker;
+    juce::OwnedArray<Worker> workers;
+    std::atomic<bool> running;
+    std::atomic<int> in_run;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RackThreadPool)
+};
@@ -0,0 +1,570 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "RackUnitMonitor.h"
+#include "Oversampler.h"
+#include "gx_plugin.h"
+#include <set>
+
+// units that may be skipped, with the time in seconds their output
+// needs to die away after the input went silent
+static const struct { const char *id; float tail; } idle_units[] = {
+    { "zita_rev1",  8.0f },
+    { "jconv",     10.0f },
+    { "jconv_mono", 10.0f },
+    { "cab",        1.0f },
+    { "cab_st",     1.0f },
+    { "pre",        1.0f },
+    { "pre_st",     1.0f },
+    { "con",        1.0f },
+    { "mbc",        0.5f },
+    { "mbcs",       0.5f },
+    { "mbd",        0.5f },
+};
+
+static const float silence_threshold = 1e-5f;   // -100 dBFS
+
+// units that may run oversampled: the tube amp stages and the pedals that
+// clip, but not the neural models, which are trained at the engine rate
+static const char *nonlinear_ids[] = { "ampstack", "ampmodul" };
+static const char *nonlinear_categories[] = { "Distortion", "Fuzz" };
+static const char *linear_prefixes[] = { "nam", "rtneural" };
+
+// the engine copies the entries into its module lists on another thread,
+// selectors and wrappers read them from the audio thread
+template <typename Fn>
+static void set_entry(Fn& entry, Fn fn)
+{
+    static_assert(sizeof(std::atomic<Fn>) == sizeof(Fn), "entry can't be stored atomically");
+    reinterpret_cast<std::atomic<Fn>&>(entry).store(fn, std::memory_order_release);
+}
+
+// bucket 0 is below 1 us, bucket k up to 2^k us
+static const int hist_size = 20;
+
+static float bucket_limit_us(int k)
+{
+    return float(1 << k);
+}
+
+struct RackUnitMonitor::Unit
+{
+    RackUnitMonitor *owner;
+    PluginDef *pdef;
+    juce::String id, chain;
+    float tail;                 // < 0: never skipped
+    bool retired;               // gone from the engine, pdef may be freed
+    std::atomic<process_mono_audio> mono;
+    std::atomic<process_stereo_audio> stereo;
+    // oversampling, see set_oversampling()
+    bool nonlinear;
+    inifunc init_rate;
+    std::unique_ptr<Oversampler> os;
+    // audio thread only
+    juce::int64 silent;
+    std::atomic<bool> idle;
+    std::atomic<juce::uint64> blocks, skipped;
+    // timing, written by the audio thread
+    std::atomic<juce::uint64> calls, sum_ns;
+    std::atomic<juce::uint32> max_ns;
+    std::atomic<juce::uint32> hist[hist_size];
+    // timing, message thread only
+    juce::uint64 last_calls, last_sum;
+    juce::uint32 last_hist[hist_size];
+    float avg_us, worst_us, p99_us;
+
+    // true when the unit can be left out for this block
+    bool is_idle(const float *in1, const float *in2, int count)
+    {
+        if (tail < 0) return false;
+        blocks.fetch_add(1, std::memory_order_relaxed);
+        if (!owner->is_enabled()) {
+            silent = 0;
+            idle.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        auto r = juce::FloatVectorOperations::findMinAndMax(in1, count);
+        float peak = std::max(-r.getStart(), r.getEnd());
+        if (in2) {
+            r = juce::FloatVectorOperations::findMinAndMax(in2, count);
+            peak = std::max(peak, std::max(-r.getStart(), r.getEnd()));
+        }
+        if (peak > silence_threshold) {
+            silent = 0;
+            idle.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        silent += count;
+        if (silent <= juce::int64(tail * owner->samplerate.load(std::memory_order_relaxed)))
+            return false;
+        idle.store(true, std::memory_order_relaxed);
+        skipped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void record(std::chrono::steady_clock::duration d)
+    {
+        juce::uint32 ns = juce::uint32(juce::jmin<juce::int64>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(), 0xffffffff));
+        calls.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+        juce::uint32 m = max_ns.load(std::memory_order_relaxed);
+        while (ns > m && !max_ns.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+        juce::uint32 us = ns / 1000;
+        int k = us ? juce::jmin(hist_size - 1, juce::findHighestSetBit(us) + 1) : 0;
+        hist[k].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int get_factor() const { return os ? os->get_factor() : 1; }
+
+    void set_oversampling(int f, int q, int block, int rate)
+    {
+        if (!nonlinear) return;
+        if (f > 1 && rate > 0) {
+            if (!os) os.reset(new Oversampler);
+            if (!os->setup(rate, f, q, block, pdef->stereo_audio ? 2 : 1))
+                os.reset();
+        } else {
+            os.reset();
+        }
+        if (init_rate && rate > 0)
+            init_rate(rate * get_factor(), pdef);
+    }
+
+    void oversample_mono(int count, float *input, float *output)
+    {
+        process_mono_audio m = mono.load(std::memory_order_acquire);
+        int f = os->get_factor();
+        for (int pos = 0; pos < count; ) {
+            int k = std::min(count - pos, os->get_max_block());
+            float *in[1] = { input + pos };
+            float *out[1] = { output + pos };
+            float *const *up = os->up(in, k);
+            m(k * f, up[0], up[0], pdef);
+            os->down(out, k);
+            pos += k;
+        }
+    }
+
+    void oversample_stereo(int count, float *input1, float *input2, float *output1, float *output2)
+    {
+        process_stereo_audio st = stereo.load(std::memory_order_acquire);
+        int f = os->get_factor();
+        for (int pos = 0; pos < count; ) {
+            int k = std::min(count - pos, os->get_max_block());
+            float *in[2] = { input1 + pos, input2 + pos };
+            float *out[2] = { output1 + pos, output2 + pos };
+            float *const *up = os->up(in, k);
+            st(k * f, up[0], up[1], up[0], up[1], pdef);
+            os->down(out, k);
+            pos += k;
+        }
+    }
+
+    void wrap()
+    {
+        if (nonlinear && pdef->set_samplerate && pdef->set_samplerate != &RackUnitMonitor::init_process) {
+            init_rate = pdef->set_samplerate;
+            set_entry(pdef->set_samplerate, &RackUnitMonitor::init_process);
+        }
+        process_mono_audio m = pdef->mono_audio;
+        if (m && m != &RackUnitMonitor::mono_process) {
+            mono.store(m, std::memory_order_release);
+            set_entry(pdef->mono_audio, &RackUnitMonitor::mono_process);
+        }
+        process_stereo_audio s = pdef->stereo_audio;
+        if (s && s != &RackUnitMonitor::stereo_process) {
+            stereo.store(s, std::memory_order_release);
+            set_entry(pdef->stereo_audio, &RackUnitMonitor::stereo_process);
+        }
+    }
+
+    void init(const juce::String& chain);
+
+    bool is_wrapped() const
+    {
+        return (!pdef->mono_audio || pdef->mono_audio == &RackUnitMonitor::mono_process)
+            && (!pdef->stereo_audio || pdef->stereo_audio == &RackUnitMonitor::stereo_process)
+            && (!nonlinear || !pdef->set_samplerate || pdef->set_samplerate == &RackUnitMonitor::init_process);
+    }
+};
+
+//==============================================================================
+// The wrappers only get the PluginDef, so the units of all instances are
+// kept in one open addressing table that the audio threads read without
+// locking. A freed slot keeps a tombstone key, so that the lookups of the
+// keys behind it still find them, enter() reuses it.
+
+namespace {
+
+const int table_size = 4096;
+PluginDef *const removed_key = reinterpret_cast<PluginDef*>(juce::pointer_sized_uint(1));
+
+struct Slot
+{
+    std::atomic<PluginDef*> key;
+    std::atomic<RackUnitMonitor::Unit*> unit;
+};
+
+Slot unit_table[table_size];
+juce::CriticalSection unit_table_cs;
+
+int slot_index(const PluginDef *pd)
+{
+    return int((reinterpret_cast<juce::pointer_sized_uint>(pd) >> 4) * 2654435761u) & (table_size - 1);
+}
+
+RackUnitMonitor::Unit *lookup(const PluginDef *pd)
+{
+    for (int i = slot_index(pd), n = 0; n < table_size; i = (i + 1) & (table_size - 1), n++) {
+        PluginDef *k = unit_table[i].key.load(std::memory_order_acquire);
+        if (k == pd) return unit_table[i].unit.load(std::memory_order_acquire);
+        if (!k) break;
+    }
+    return nullptr;
+}
+
+bool enter(PluginDef *pd, RackUnitMonitor::Unit *u)
+{
+    const juce::ScopedLock lock(unit_table_cs);
+    int free_slot = -1;
+    for (int i = slot_index(pd), n = 0; n < table_size; i = (i + 1) & (table_size - 1), n++) {
+        PluginDef *k = unit_table[i].key.load(std::memory_order_relaxed);
+        if (k == pd) {
+            unit_table[i].unit.store(u, std::memory_order_release);
+            return true;
+        }
+        if (k == removed_key && free_slot < 0)
+            free_slot = i;
+        if (!k) {
+            if (free_slot < 0)
+                free_slot = i;
+            break;
+        }
+    }
+    if (free_slot < 0) {
+        jassertfalse;   // more wrapped units than slots
+        return false;
+    }
+    unit_table[free_slot].unit.store(u, std::memory_order_release);
+    unit_table[free_slot].key.store(pd, std::memory_order_release);
+    return true;
+}
+
+void leave(const PluginDef *pd)
+{
+    const juce::ScopedLock lock(unit_table_cs);
+    for (int i = slot_index(pd), n = 0; n < table_size; i = (i + 1) & (table_size - 1), n++) {
+        PluginDef *k = unit_table[i].key.load(std::memory_order_relaxed);
+        if (k == pd) {
+            unit_table[i].key.store(removed_key, std::memory_order_release);
+            unit_table[i].unit.store(nullptr, std::memory_order_release);
+            return;
+        }
+        if (!k) return;
+    }
+}
+
+} // anonymous namespace
+
+//==============================================================================
+
+RackUnitMonitor::RackUnitMonitor()
+    : samplerate(48000), enabled(true), profiling(false),
+      factor(1), quality(0), maxBlock(0), latency(0)
+{
+}
+
+bool RackUnitMonitor::is_nonlinear(const PluginDef *pd)
+{
+    if (!pd->id) return false;
+    for (auto p : linear_prefixes)
+        if (strncmp(pd->id, p, strlen(p)) == 0) return false;
+    for (auto id : nonlinear_ids)
+        if (strcmp(pd->id, id) == 0) return true;
+    for (auto c : nonlinear_categories)
+        if (pd->category && strcmp(pd->category, c) == 0) return true;
+    return false;
+}
+
+RackUnitMonitor::~RackUnitMonitor()
+{
+    uninstall();
+}
+
+void RackUnitMonitor::Unit::init(const juce::String& chain_)
+{
+    id = pdef->id;
+    chain = chain_;
+    tail = -1;
+    for (auto& d : idle_units)
+        if (id == d.id) tail = d.tail;
+    retired = false;
+    nonlinear = is_nonlinear(pdef);
+    if (pdef->set_samplerate != &RackUnitMonitor::init_process)
+        init_rate = nullptr;
+}
+
+int RackUnitMonitor::install(const std::vector<PluginDef*>& pdefs, const juce::String& chain)
+{
+    int n = 0;
+    std::set<Unit*> seen;
+    for (PluginDef *pd : pdefs) {
+        if (!pd || (!pd->mono_audio && !pd->stereo_audio))
+            continue;
+        if (Unit *u = lookup(pd)) {
+            if (u->owner != this)
+                continue;
+            // a freed PluginDef can come back at the same address
+            bool fresh = u->retired || u->chain != chain;
+            if (fresh) {
+                u->init(chain);
+                u->os.reset();
+            }
+            if (!u->is_wrapped()) {
+                // a selector got the code of another module, which the
+                // engine set up for its own rate
+                u->wrap();
+                if (factor > 1)
+                    u->set_oversampling(factor, quality, maxBlock, samplerate.load(std::memory_order_relaxed));
+                n++;
+            }
+            seen.insert(u);
+            continue;
+        }
+        std::unique_ptr<Unit> u(new Unit);
+        u->owner = this;
+        u->pdef = pd;
+        u->init(chain);
+        u->mono = nullptr;
+        u->stereo = nullptr;
+        u->silent = 0;
+        u->idle = false;
+        u->blocks = 0;
+        u->skipped = 0;
+        u->calls = 0;
+        u->sum_ns = 0;
+        u->max_ns = 0;
+        for (auto& h : u->hist) h = 0;
+        u->last_calls = u->last_sum = 0;
+        for (auto& h : u->last_hist) h = 0;
+        u->avg_us = u->worst_us = u->p99_us = 0;
+        if (!enter(pd, u.get()))
+            continue;
+        u->wrap();
+        // the engine set it up for its own rate already
+        if (factor > 1)
+            u->set_oversampling(factor, quality, maxBlock, samplerate.load(std::memory_order_relaxed));
+        seen.insert(u.get());
+        units.push_back(std::move(u));
+        n++;
+    }
+    // units the engine dropped (LV2 plugins) keep their slot until
+    // release_retired(), as the old module chain may still call them
+    for (auto& u : units)
+        if (u->chain == chain && !seen.count(u.get()))
+            u->retired = true;
+    return n;
+}
+
+void RackUnitMonitor::uninstall()
+{
+    // only called with the engines stopped
+    for (auto& u : units) {
+        if (!u->retired) {
+            if (u->pdef->mono_audio == &RackUnitMonitor::mono_process)
+                set_entry(u->pdef->mono_audio, u->mono.load());
+            if (u->pdef->stereo_audio == &RackUnitMonitor::stereo_process)
+                set_entry(u->pdef->stereo_audio, u->stereo.load());
+            if (u->init_rate && u->pdef->set_samplerate == &RackUnitMonitor::init_process)
+                set_entry(u->pdef->set_samplerate, u->init_rate);
+        }
+        leave(u->pdef);
+    }
+    units.clear();
+}
+
+void RackUnitMonitor::release_retired()
+{
+    for (auto i = units.begin(); i != units.end(); ) {
+        if ((*i)->retired) {
+            leave((*i)->pdef);
+            i = units.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void RackUnitMonitor::mono_process(int count, float *input, float *output, PluginDef *pd)
+{
+    Unit *u = lookup(pd);
+    jassert(u != nullptr);
+    bool timed = u->owner->is_profiling();
+    auto t0 = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    if (u->is_idle(input, nullptr, count))
+        juce::FloatVectorOperations::clear(output, count);
+    else if (u->os)
+        u->oversample_mono(count, input, output);
+    else
+        u->mono.load(std::memory_order_acquire)(count, input, output, pd);
+    if (timed)
+        u->record(std::chrono::steady_clock::now() - t0);
+}
+
+void RackUnitMonitor::stereo_process(int count, float *input1, float *input2,
+                                     float *output1, float *output2, PluginDef *pd)
+{
+    Unit *u = lookup(pd);
+    jassert(u != nullptr);
+    bool timed = u->owner->is_profiling();
+    auto t0 = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    if (u->is_idle(input1, input2, count)) {
+        juce::FloatVectorOperations::clear(output1, count);
+        juce::FloatVectorOperations::clear(output2, count);
+    }
+    else if (u->os)
+        u->oversample_stereo(count, input1, input2, output1, output2);
+    else
+        u->stereo.load(std::memory_order_acquire)(count, input1, input2, output1, output2, pd);
+    if (timed)
+        u->record(std::chrono::steady_clock::now() - t0);
+}
+
+// the engine sets the units up for its rate, the oversampled ones get
+// factor times that
+void RackUnitMonitor::init_process(unsigned int rate, PluginDef *pd)
+{
+    Unit *u = lookup(pd);
+    jassert(u != nullptr);
+    u->init_rate(rate * u->get_factor(), pd);
+}
+
+void RackUnitMonitor::set_oversampling(int f, int q, int block)
+{
+    factor = f;
+    quality = q;
+    maxBlock = block;
+    int rate = samplerate.load(std::memory_order_relaxed);
+    for (auto& u : units)
+        if (!u->retired)
+            u->set_oversampling(f, q, block, rate);
+    Oversampler probe;
+    latency = (f > 1 && probe.setup(rate, f, q, 1, 1)) ? probe.get_latency() : 0;
+}
+
+std::vector<RackUnitMonitor::UnitStats> RackUnitMonitor::get_stats() const
+{
+    std::vector<UnitStats> v;
+    for (auto& u : units) {
+        if (u->tail < 0 || u->retired) continue;
+        v.push_back({ u->id, u->chain, u->idle.load(std::memory_order_relaxed),
+                      u->blocks.load(std::memory_order_relaxed),
+                      u->skipped.load(std::memory_order_relaxed) });
+    }
+    return v;
+}
+
+juce::String RackUnitMonitor::get_report() const
+{
+    juce::String s;
+    juce::uint64 blocks = 0, skipped = 0;
+    for (auto& st : get_stats()) {
+        // units that are not in the rack are never called
+        if (!st.blocks) continue;
+        s << st.id << " (" << st.chain << "): " << (st.idle ? "idle" : "running")
+          << ", " << juce::String(100.0 * st.skipped / st.blocks, 1) << "% of "
+          << juce::String(st.blocks) << " blocks skipped\n";
+        blocks += st.blocks;
+        skipped += st.skipped;
+    }
+    if (!blocks)
+        return "None of the monitored units is in the rack.\n";
+    s << "\nSkipped " << juce::String(skipped) << " of " << juce::String(blocks) << " unit blocks";
+    if (!is_enabled())
+        s << " (skipping is switched off)";
+    return s << "\n";
+}
+
+void RackUnitMonitor::update_timing()
+{
+    for (auto& u : units) {
+        juce::uint64 calls = u->calls.load(std::memory_order_relaxed);
+        juce::uint64 sum = u->sum_ns.load(std::memory_order_relaxed);
+        juce::uint32 worst = u->max_ns.exchange(0, std::memory_order_relaxed);
+        juce::uint32 h[hist_size], total = 0;
+        for (int k = 0; k < hist_size; k++) {
+            juce::uint32 c = u->hist[k].load(std::memory_order_relaxed);
+            h[k] = c - u->last_hist[k];
+            u->last_hist[k] = c;
+            total += h[k];
+        }
+        juce::uint64 n = calls - u->last_calls;
+        u->avg_us = n ? float(sum - u->last_sum) / n / 1000.0f : 0.0f;
+        u->worst_us = n ? worst / 1000.0f : 0.0f;
+        u->p99_us = 0.0f;
+        for (juce::uint32 k = 0, acc = 0; total && k < juce::uint32(hist_size); k++) {
+            acc += h[k];
+            if (acc * 100ull >= total * 99ull) {
+                u->p99_us = bucket_limit_us(int(k));
+                break;
+            }
+        }
+        u->last_calls = calls;
+        u->last_sum = sum;
+    }
+}
+
+bool RackUnitMonitor::get_timing(const PluginDef *pd, UnitTiming& t) const
+{
+    const Unit *u = pd ? lookup(pd) : nullptr;
+    if (!u || u->owner != this || u->retired || !u->avg_us)
+        return false;
+    t = { u->id, u->chain, u->avg_us, u->worst_us, u->p99_us };
+    return true;
+}
+
+std::vector<RackUnitMonitor::UnitTiming> RackUnitMonitor::get_timings() const
+{
+    std::vector<UnitTiming> v;
+    for (auto& u : units)
+        if (!u->retired && u->avg_us)
+            v.push_back({ u->id, u->chain, u->avg_us, u->worst_us, u->p99_us });
+    std::sort(v.begin(), v.end(), [](const UnitTiming& a, const UnitTiming& b) {
+        return a.avg_us > b.avg_us; });
+    return v;
+}
+
+juce::String RackUnitMonitor::get_timing_report() const
+{
+    if (!is_profiling())
+        return "Profiling is switched off.\n";
+    auto v = get_timings();
+    if (v.empty())
+        return "No rack unit has been running since the last update.\n";
+    juce::String s;
+    float sum = 0;
+    for (auto& t : v) {
+        s << t.id << " (" << t.chain << "): avg " << juce::String(t.avg_us, 1)
+          << " us, 99% below " << juce::String(t.p99_us, 0)
+          << " us, worst " << juce::String(t.worst_us, 1) << " us\n";
+        sum += t.avg_us;
+    }
+    s << "\nAll units: avg " << juce::String(sum, 1) << " us per block\n";
+    return s;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+
+struct PluginDef;
+
+//==============================================================================
+/*
+** Watches the rack units from inside the module chain.
+**
+** install() replaces the mono_audio/stereo_audio entries of the units by
+** wrappers that call the original code.
+**
+** The amp and distortion stages (the tube amp, the Distortion and Fuzz
+** categories) can run oversampled: their set_samplerate entry is wrapped
+** too and sets them up for factor times the engine rate, the audio
+** wrappers resample each block up and down around them. Everything else,
+** convolvers, reverbs and neural models included, stays at the engine
+** rate.
+**
+** Units with long tails or heavy processing (reverbs, convolvers,
+** multiband units) are skipped while they only produce their own silence:
+** once the input has stayed below -100 dBFS for longer than the declared
+** tail of the unit, it is not called any more and its output is cleared,
+** until the input comes back. Generators and analysers are never skipped.
+**
+** With profiling switched on every call is timed with steady_clock. The
+** audio threads only add to per unit counters and a log2 histogram,
+** update_timing() turns them into the average and worst time per block
+** since the previous update.
+*/
+class RackUnitMonitor
+{
+public:
+    struct Unit;
+    struct UnitStats
+    {
+        juce::String id, chain;
+        bool idle;
+        juce::uint64 blocks, skipped;
+    };
+    struct UnitTiming
+    {
+        juce::String id, chain;
+        float avg_us, worst_us, p99_us;   // 0 if not called
+    };
+
+    RackUnitMonitor();
+    ~RackUnitMonitor();
+
+    // wraps the given units of one engine, chain names the engine in the
+    // reports. Can be called again to pick up new units and units whose
+    // entries were replaced (module selectors). The engine uses the
+    // wrappers from the next rack rebuild. Returns the number of entries
+    // that changed.
+    int install(const std::vector<PluginDef*>& pdefs, const juce::String& chain);
+    void uninstall();
+    // drops the units install() found gone from the engine, once the engine
+    // has released the module chains that still called them
+    void release_retired();
+
+    // engine rate
+    void set_samplerate(int rate) { samplerate.store(rate, std::memory_order_relaxed); }
+    // sets the oversampled units up for factor (1: off), maxBlock is the
+    // engine's block size. Message thread, with the engines ramped down
+    // or stopped, as the audio wrappers use the resamplers unlocked.
+    void set_oversampling(int factor, int quality, int maxBlock);
+    int get_oversampling_factor() const { return factor; }
+    int get_oversampling_quality() const { return quality; }
+    // delay of one oversampled unit in engine samples
+    int get_oversampling_latency() const { return latency; }
+    static bool is_nonlinear(const PluginDef *pd);
+    void set_enabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+    bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+    void set_profiling(bool on) { profiling.store(on, std::memory_order_relaxed); }
+    bool is_profiling() const { return profiling.load(std::memory_order_relaxed); }
+
+    std::vector<UnitStats> get_stats() const;
+    juce::String get_report() const;
+
+    // message thread
+    void update_timing();
+    bool get_timing(const PluginDef *pd, UnitTiming& t) const;
+    std::vector<UnitTiming> get_timings() const;
+    juce::String get_timing_report() const;
+
+private:
+    static void mono_process(int count, float *input, float *output, PluginDef *pd);
+    static void stereo_process(int count, float *input1, float *input2,
+                               float *output1, float *output2, PluginDef *pd);
+    static void init_process(unsigned int rate, PluginDef *pd);
+
+    std::vector<std::unique_ptr<Unit>> units;
+    std::atomic<int> samplerate;
+    std::atomic<bool> enabled, profiling;
+    int factor, quality, maxBlock, latency;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RackUnitMonitor)
+};
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "RtSafetyCheck.h"
+
+#if GX_RT_CHECK
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace rt_check {
+
+static const char *kind_names[num_kinds] = { "malloc", "free", "mutex lock" };
+
+const char *get_kind_name(Kind kind)
+{
+    return kind_names[juce::jlimit(0, num_kinds - 1, int(kind))];
+}
+
+#if GX_RT_CHECK
+
+static const int max_sites = 256;
+static const int max_frames = 24;
+static const int skip_frames = 2;   // record() and the replaced function
+static const int key_frames = 4;    // a site is the innermost frames, not the whole path
+
+struct Slot
+{
+    std::atomic<juce::uint64> key;
+    std::atomic<bool> ready;
+    std::atomic<juce::uint64> count;
+    int kind, nframes;
+    void *frames[max_frames];
+};
+
+static Slot slots[max_sites];
+static std::atomic<juce::uint64> totals[num_kinds];
+static std::atomic<bool> fatal { false };
+
+// initial-exec, so reading them never allocates, not even in a dlopened module
+static __thread int depth __attribute__((tls_model("initial-exec")));
+static __thread bool in_hook __attribute__((tls_model("initial-exec")));
+
+static juce::uint64 site_key(int kind, void **frames, int n)
+{
+    juce::uint64 h = 1469598103934665603ull ^ juce::uint64(kind);
+    for (int i = 0; i < n; i++)
+        h = (h ^ juce::uint64(reinterpret_cast<juce::pointer_sized_uint>(frames[i]))) * 1099511628211ull;
+    return h ? h : 1;
+}
+
+static void record(Kind kind)
+{
+    if (!depth || in_hook)
+        return;
+    in_hook = true;
+    totals[kind].fetch_add(1, std::memory_order_relaxed);
+    void *frames[max_frames + skip_frames];
+    int n = backtrace(frames, max_frames + skip_frames) - skip_frames;
+    if (n > 0) {
+        void **f = frames + skip_frames;
+        juce::uint64 key = site_key(kind, f, std::min(n, key_frames));
+        for (int i = 0; i < max_sites; i++) {
+            Slot& s = slots[(key + i) % max_sites];
+            juce::uint64 k = s.key.load(std::memory_order_acquire);
+            if (k == 0 && s.key.compare_exchange_strong(k, key)) {
+                s.kind = kind;
+                s.nframes = n;
+                memcpy(s.frames, f, n * sizeof(void*));
+                s.ready.store(true, std::memory_order_release);
+                k = key;
+            }
+            if (k == key) {
+                s.count.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        if (fatal.load(std::memory_order_relaxed)) {
+            static const char msg[] = "guitarix: realtime violation inside processBlock: ";
+            write(2, msg, sizeof(msg) - 1);
+            write(2, kind_names[kind], strlen(kind_names[kind]));
+            write(2, "\n", 1);
+            backtrace_symbols_fd(f, n, 2);
+            abort();
+        }
+    }
+    in_hook = false;
+}
+
+Scope::Scope() { depth++; }
+Scope::~Scope() { depth--; }
+
+//------------------------------------------------------------------------------
+// the replacements, exported so they also catch calls from the libraries
+
+typedef int (*mutex_lock_fn)(pthread_mutex_t *);
+static mutex_lock_fn real_mutex_lock = nullptr;
+
+static mutex_lock_fn find_mutex_lock()
+{
+    if (!real_mutex_lock)
+        real_mutex_lock = reinterpret_cast<mutex_lock_fn>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+    return real_mutex_lock;
+}
+
+// backtrace() loads libgcc_s on its first call, do that before any
+// audio thread needs it
+static struct Init
+{
+    Init()
+    {
+        void *f[2];
+        backtrace(f, 2);
+        find_mutex_lock();
+        const char *e = getenv("GUITARIX_RT_CHECK");
+        fatal = e && strcmp(e, "abort") == 0;
+    }
+} init;
+
+} // namespace rt_check
+
+extern "C" {
+
+void *__libc_malloc(size_t n);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t n);
+void __libc_free(void *p);
+
+__attribute__((visibility("default"))) void *malloc(size_t n) __THROW
+{
+    rt_check::record(rt_check::kind_malloc);
+    return __libc_malloc(n);
+}
+
+__attribute__((visibility("default"))) void *calloc(size_t n, size_t size) __THROW
+{
+    rt_check::record(rt_check::kind_malloc);
+    return __libc_calloc(n, size);
+}
+
+__attribute__((visibility("default"))) void *realloc(void *p, size_t n) __THROW
+{
+    rt_check::record(rt_check::kind_malloc);
+    return __libc_realloc(p, n);
+}
+
+__attribute__((visibility("default"))) void free(void *p) __THROW
+{
+    if (p)
+        rt_check::record(rt_check::kind_free);
+    __libc_free(p);
+}
+
+__attribute__((visibility("default"))) int pthread_mutex_lock(pthread_mutex_t *m) __THROWNL
+{
+    rt_check::record(rt_check::kind_lock);
+    return rt_check::find_mutex_lock()(m);
+}
+
+} // extern "C"
+
+namespace rt_check {
+
+bool available() { return true; }
+
+void set_fatal(bool on) { fatal = on; }
+
+void reset()
+{
+    for (auto& s : slots) {
+        s.ready = false;
+        s.count = 0;
+        s.key = 0;
+    }
+    for (auto& t : totals)
+        t = 0;
+}
+
+juce::uint64 get_total(Kind kind)
+{
+    return totals[juce::jlimit(0, num_kinds - 1, int(kind))].load(std::memory_order_relaxed);
+}
+
+// "module(mangled+0x1a) [0x4005d4]" -> "function (module)"
+static juce::String symbolize(const char *sym)
+{
+    juce::String s(sym);
+    juce::String module = s.upToFirstOccurrenceOf("(", false, false).fromLastOccurrenceOf("/", false, false);
+    juce::String name = s.fromFirstOccurrenceOf("(", false, false).upToFirstOccurrenceOf("+", false, false);
+    if (name.isEmpty() || name.containsChar(')'))
+        return s;
+    int status = 0;
+    char *d = abi::__cxa_demangle(name.toRawUTF8(), nullptr, nullptr, &status);
+    if (d) {
+        name = d;
+        free(d);
+    }
+    return name + " (" + module + ")";
+}
+
+std::vector<Site> get_sites()
+{
+    std::vector<Site> r;
+    for (auto& s : slots) {
+        if (!s.ready.load(std::memory_order_acquire))
+            continue;
+        Site site { Kind(s.kind), s.count.load(std::memory_order_relaxed), {} };
+        char **syms = backtrace_symbols(s.frames, s.nframes);
+        for (int i = 0; i < s.nframes; i++)
+            site.stack.add(syms ? symbolize(syms[i]) : juce::String::toHexString(
+                               juce::pointer_sized_int(s.frames[i])));
+        free(syms);
+        r.push_back(site);
+    }
+    std::sort(r.begin(), r.end(), [](const Site& a, const Site& b) { return a.count > b.count; });
+    return r;
+}
+
+#else
+
+bool available() { return false; }
+void set_fatal(bool) {}
+void reset() {}
+juce::uint64 get_total(Kind) { return 0; }
+std::vector<Site> get_sites() { return {}; }
+
+#endif
+
+juce::String get_report()
+{
+    if (!available())
+        return "not built with RT_CHECK=1";
+    juce::String s;
+    for (int k = 0; k < num_kinds; k++)
+        s << juce::String(get_total(Kind(k))) << " " << kind_names[k] << (k + 1 < num_kinds ? ", " : "");
+    s << " inside processBlock\n";
+    for (auto& site : get_sites()) {
+        s << "\n" << juce::String(site.count) << "x " << get_kind_name(site.kind) << "\n";
+        for (int i = 0; i < site.stack.size() && i < 8; i++)
+            s << "    " << site.stack[i] << "\n";
+    }
+    return s;
+}
+
+} // namespace rt_check
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+//==============================================================================
+/*
+** Debug check for heap use and blocking locks on the audio thread.
+**
+** Built with "make RT_CHECK=1" (defines GX_RT_CHECK): malloc, calloc,
+** realloc, free and pthread_mutex_lock are replaced, and every call made
+** on a thread while it is inside a Scope (processBlock) is counted per
+** call site together with its stack. The replacements take effect in the
+** executables (Standalone, procbench); a VST3 loaded into a host keeps
+** using the host's allocator.
+**
+** With GUITARIX_RT_CHECK=abort in the environment (or set_fatal(true))
+** the first violation prints its stack and aborts.
+**
+** Without GX_RT_CHECK a Scope is empty and available() returns false.
+*/
+namespace rt_check {
+
+enum Kind { kind_malloc, kind_free, kind_lock, num_kinds };
+
+struct Site
+{
+    Kind kind;
+    juce::uint64 count;
+    juce::StringArray stack;   // innermost frame first
+};
+
+#if GX_RT_CHECK
+struct Scope
+{
+    Scope();
+    ~Scope();
+    JUCE_DECLARE_NON_COPYABLE (Scope)
+};
+#else
+struct Scope
+{
+    Scope() {}
+};
+#endif
+
+bool available();
+void set_fatal(bool on);
+// forgets all recorded sites, don't call while an audio thread runs
+void reset();
+juce::uint64 get_total(Kind kind);
+std::vector<Site> get_sites();
+juce::String get_report();
+const char *get_kind_name(Kind kind);
+
+} // namespace rt_check
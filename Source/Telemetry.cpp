@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Telemetry.h"
+#include "DisplayRefresh.h"
+
+static const char *event_names[Telemetry::num_types] = {
+    "processBlock", "quantum", "program change", "bank change",
+    "lock wait", "set program" };
+
+static const char *lock_names[] = { "update_cs", "load_cs" };
+
+// a block that starts this much later than the previous deadline means
+// the host did not call us in time
+static const double host_late_factor = 1.5;
+
+Telemetry::Telemetry()
+    : t0(std::chrono::steady_clock::now()),
+      audio_rb(jack_ringbuffer_create(4096 * sizeof(Event))),
+      other_rb(jack_ringbuffer_create(256 * sizeof(Event))),
+      dropped(0),
+      history(history_size),
+      head(0), count(0)
+{
+    jack_ringbuffer_mlock(audio_rb);
+    DisplayRefresh::add_task(this, 200, [this] { collect(); });
+}
+
+Telemetry::~Telemetry()
+{
+    DisplayRefresh::remove_tasks(this);
+    jack_ringbuffer_free(audio_rb);
+    jack_ringbuffer_free(other_rb);
+}
+
+juce::int64 Telemetry::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+void Telemetry::audio_event(int type, int arg, juce::int64 start, juce::int64 dur, juce::int64 deadline)
+{
+    Event e = { type, arg, start, dur, deadline };
+    if (jack_ringbuffer_write_space(audio_rb) < sizeof(e))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    else
+        jack_ringbuffer_write(audio_rb, reinterpret_cast<const char*>(&e), sizeof(e));
+}
+
+void Telemetry::event(int type, int arg, juce::int64 start, juce::int64 dur)
+{
+    Event e = { type, arg, start, dur, 0 };
+    const juce::ScopedLock lock(other_cs);
+    if (jack_ringbuffer_write_space(other_rb) < sizeof(e))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    else
+        jack_ringbuffer_write(other_rb, reinterpret_cast<const char*>(&e), sizeof(e));
+}
+
+void Telemetry::drain(jack_ringbuffer_t *rb)
+{
+    Event e;
+    while (jack_ringbuffer_read_space(rb) >= sizeof(e)) {
+        jack_ringbuffer_read(rb, reinterpret_cast<char*>(&e), sizeof(e));
+        history[(head + count) % history_size] = e;
+        if (count < history_size)
+            count++;
+        else
+            head = (head + 1) % history_size;
+    }
+}
+
+void Telemetry::collect()
+{
+    const juce::ScopedLock lock(history_cs);
+    drain(audio_rb);
+    drain(other_rb);
+}
+
+int Telemetry::get_num_events()
+{
+    collect();
+    const juce::ScopedLock lock(history_cs);
+    return count;
+}
+
+juce::String Telemetry::get_summary()
+{
+    collect();
+    const juce::ScopedLock lock(history_cs);
+    int blocks = 0, missed = 0, late = 0;
+    juce::int64 worst = 0, last_start = -1, last_deadline = 0;
+    for (int i = 0; i < count; i++) {
+        const Event& e = history[(head + i) % history_size];
+        if (e.type != block) continue;
+        blocks++;
+        if (e.deadline && e.dur > e.deadline) missed++;
+        worst = std::max(worst, e.dur);
+        if (last_start >= 0 && e.start - last_start > host_late_factor * last_deadline)
+            late++;
+        last_start = e.start;
+        last_deadline = e.deadline;
+    }
+    juce::String s;
+    s << juce::String(blocks) << " blocks, " << juce::String(missed) << " over their deadline, "
+      << juce::String(late) << " called late by the host, worst "
+      << juce::String(worst / 1000.0, 1) << " us";
+    if (get_dropped())
+        s << ", " << juce::String(get_dropped()) << " events dropped";
+    return s;
+}
+
+bool Telemetry::write_trace(const juce::File& file)
+{
+    collect();
+    juce::FileOutputStream os(file);
+    if (!os.openedOk())
+        return false;
+    os.setPosition(0);
+    os.truncate();
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"audio\"}},\n"
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"host / message\"}}";
+
+    const juce::ScopedLock lock(history_cs);
+    juce::int64 last_start = -1, last_deadline = 0;
+    for (int i = 0; i < count; i++) {
+        const Event& e = history[(head + i) % history_size];
+        if (e.type < 0 || e.type >= num_types) continue;
+        int tid = (e.type == lock_wait || e.type == set_program) ? 2 : 1;
+        juce::String ts(e.start / 1000.0, 3);
+        os << ",\n{\"name\":\"" << event_names[e.type] << "\",\"ph\":\"X\",\"ts\":" << ts
+           << ",\"dur\":" << juce::String(e.dur / 1000.0, 3)
+           << ",\"pid\":1,\"tid\":" << tid << ",\"args\":{";
+        switch (e.type) {
+        case block:
+            os << "\"samples\":" << e.arg
+               << ",\"deadline_us\":" << juce::String(e.deadline / 1000.0, 1)
+               << ",\"load\":" << juce::String(e.deadline ? double(e.dur) / e.deadline : 0.0, 3);
+            break;
+        case quantum:
+            os << "\"samples\":" << e.arg;
+            break;
+        case lock_wait:
+            os << "\"lock\":\"" << lock_names[juce::jlimit(0, 1, int(e.arg))] << "\"";
+            break;
+        default:
+            os << "\"value\":" << e.arg;
+            break;
+        }
+        os << "}}";
+        if (e.type != block) continue;
+        if (e.deadline && e.dur > e.deadline)
+            os << ",\n{\"name\":\"deadline missed\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << ts
+               << ",\"pid\":1,\"tid\":1}";
+        if (last_start >= 0 && e.start - last_start > host_late_factor * last_deadline)
+            os << ",\n{\"name\":\"host late\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << ts
+               << ",\"pid\":1,\"tid\":1,\"args\":{\"gap_us\":"
+               << juce::String((e.start - last_start) / 1000.0, 1) << "}}";
+        last_start = e.start;
+        last_deadline = e.deadline;
+    }
+    os << "\n]}\n";
+    os.flush();
+    return os.getStatus().wasOk();
+}
+
+//==============================================================================
+
+Telemetry::TimedLock::TimedLock(Telemetry& t, const juce::CriticalSection& cs_, int lock)
+    : cs(cs_)
+{
+    juce::int64 start = t.now();
+    cs.enter();
+    t.event(lock_wait, lock, start, t.now() - start);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ringbuffer.h"
+
+//==============================================================================
+/*
+** Always-on timing record of the audio thread.
+**
+** The audio thread writes fixed size events (blocks with their deadline,
+** quantum calls, program changes) into a jack_ringbuffer, other threads
+** (lock waits, host program changes) into a second one under a lock. A
+** DisplayRefresh task on the message thread moves them into a history of
+** the last history_size events, which write_trace() saves in the Chrome
+** trace event format (chrome://tracing, ui.perfetto.dev).
+*/
+class Telemetry
+{
+public:
+    enum Type { block, quantum, program_change, bank_change,
+                lock_wait, set_program, num_types };
+    enum Lock { ir_lock, model_lock };
+
+    struct Event
+    {
+        juce::int32 type, arg;
+        juce::int64 start, dur, deadline;   // ns, start relative to the telemetry start
+    };
+
+    static const int history_size = 1 << 16;
+
+    Telemetry();
+    ~Telemetry();
+
+    juce::int64 now() const;
+
+    // audio thread only
+    void audio_event(int type, int arg, juce::int64 start, juce::int64 dur, juce::int64 deadline = 0);
+    // any other thread
+    void event(int type, int arg, juce::int64 start, juce::int64 dur);
+
+    // moves new events into the history, done by the refresh task, call
+    // it directly where no message loop runs
+    void collect();
+    int get_num_events();
+    juce::uint32 get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+    juce::String get_summary();
+    bool write_trace(const juce::File& file);
+
+    // enters cs and records how long that took
+    class TimedLock
+    {
+    public:
+        TimedLock(Telemetry& t, const juce::CriticalSection& cs, int lock);
+        ~TimedLock() { cs.exit(); }
+    private:
+        const juce::CriticalSection& cs;
+        JUCE_DECLARE_NON_COPYABLE (TimedLock)
+    };
+
+private:
+    void drain(jack_ringbuffer_t *rb);
+
+    std::chrono::steady_clock::time_point t0;
+    jack_ringbuffer_t *audio_rb, *other_rb;
+    juce::CriticalSection other_cs;
+    std::atomic<juce::uint32> dropped;
+
+    juce::CriticalSection history_cs;
+    std::vector<Event> history;
+    int head, count;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Telemetry)
+};
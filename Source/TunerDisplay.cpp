@@ -17,6 +17,7 @@
  */
 
 #include "TunerDisplay.h"
+#include "DisplayRefresh.h"
 
 static const char* note_sharp[] = {"A","A#","B","C","C#","D","D#","E","F","F#","G","G#"};
 static const char* note_flat[] = {"A","Bb","B","C","Db","D","Eb","E","F","Gb","G","Ab"};
@@ -29,11 +30,15 @@ static const char* octave[] = {"0","1","2","3","4","5"," "};
 
 TunerDisplay::TunerDisplay(gx_engine::GxMachine *machine_) :
     machine(machine_),
-    font ("FreeMono", 20 , juce::Font::bold )
+    freq(0.f),
+    dirty(false),
+    painted_freq(0.f),
+    font ("FreeMono", 20 , juce::Font::bold ),
+    move(0),
+    smove(0)
 {
     // set default values
     setOpaque(true);
-    freq = 0.f;
     ref_freq = machine->get_parameter_value<float>("ui.tuner_reference_pitch");
     tunning = machine->get_parameter_value<int>("racktuner.temperament");
     use = machine->get_parameter_value<bool>("ui.racktuner");
@@ -48,6 +53,7 @@ TunerDisplay::TunerDisplay(gx_engine::GxMachine *machine_) :
         sigc::mem_fun(this, &TunerDisplay::on_tunning_changed));
     use_conn = machine->get_parameter("ui.racktuner").getBool().signal_changed().connect(
         sigc::mem_fun(this, &TunerDisplay::on_use_changed));
+    DisplayRefresh::add(this, [this] { refresh(); });
 }
 
 TunerDisplay::~TunerDisplay() 
@@ -56,21 +62,41 @@ TunerDisplay::~TunerDisplay()
     if (ref_freq_conn.connected()) ref_freq_conn.disconnect();
     if (tunning_conn.connected()) tunning_conn.disconnect();
     if (use_conn.connected()) use_conn.disconnect();
+    DisplayRefresh::remove(this);
 }
 
-void TunerDisplay::paint(juce::Graphics& g)
+// what the display shows of a frequency, 0 for none
+static long freq_key(float f) {
+    return f < 20.0f ? 0 : std::lround(f * 100);
+}
+
+void TunerDisplay::refresh()
 {
-    // paint background
-    auto bounds = getLocalBounds().toFloat();
-    g.setFont (font);
+    bool moving = use && freq_key(painted_freq) && (smove != 0 || move != 0);
+    if (dirty.exchange(false) || moving || freq_key(freq.load()) != freq_key(painted_freq))
+        repaint();
+}
+
+void TunerDisplay::resized()
+{
+    int width = getWidth();
+    left_triangle.clear();
+    left_triangle.addTriangle(0, 0, -30, 15, -30, -15);
+    right_triangle.clear();
+    right_triangle.addTriangle(0, 0, 30, 15, 30, -15);
+
+    float scale = juce::Component::getApproximateScaleFactorForComponent(this);
+    int w = juce::roundToInt(width * scale), h = juce::roundToInt(getHeight() * scale);
+    if (w <= 0 || h <= 0) {
+        background = juce::Image();
+        return;
+    }
+    background = juce::Image(juce::Image::RGB, w, h, false);
+    juce::Graphics g(background);
+    g.addTransform(juce::AffineTransform::scale(scale));
     g.setColour(juce::Colours::white.withBrightness(0.4f));
     g.fillAll();
-
-    int width = bounds.getWidth();
-    int height = bounds.getHeight();
-    float value = freq;
     float c = 0.3f;
-
     g.setColour(juce::Colour::fromRGBA(66*c, 162*c, 200*c, 188*c));
     int i = 0;
     for (; i < width/20; ++i) {
@@ -79,6 +105,20 @@ void TunerDisplay::paint(juce::Graphics& g)
     for (; i >0; --i) {
         g.fillRect ((width/2)-i*10.0f, 5.0f, 5.0f, 5.0f);
     }
+}
+
+void TunerDisplay::paint(juce::Graphics& g)
+{
+    // paint background
+    auto bounds = getLocalBounds().toFloat();
+    g.setFont (font);
+    if (background.isValid())
+        g.drawImage(background, bounds);
+
+    int width = bounds.getWidth();
+    int height = bounds.getHeight();
+    float value = freq.load();
+    painted_freq = value;
 
     if (value < 20.0f || !use) {
         draw_empty_freq(g, width, height);
@@ -107,7 +147,7 @@ void TunerDisplay::paint(juce::Graphics& g)
     }
 
     // paint the results to screen
-    c = std::max(0.0,1.0-(std::fabs(scale)*6.0));
+    float c = std::max(0.0,1.0-(std::fabs(scale)*6.0));
     float b = scale > -0.004 ? 0.3 : 1.0;
     float d = scale < 0.004 ? 0.3 : 1.0;
     g.setColour (juce::Colours::white.withAlpha (c));
@@ -117,7 +157,7 @@ void TunerDisplay::paint(juce::Graphics& g)
     g.drawSingleLineText(juce::String(octave[indicate_oc]), width*0.52, height-8);
     g.setColour (juce::Colours::white.withAlpha (0.9f));
     g.drawSingleLineText(cents(scale), 100, height-5,  juce::Justification::Flags::right);
-    g.drawSingleLineText((juce::String(freq, 2) + juce::String("Hz")), width-20, height-5,  juce::Justification::Flags::right);
+    g.drawSingleLineText((juce::String(value, 2) + juce::String("Hz")), width-20, height-5,  juce::Justification::Flags::right);
     draw_triangle(g, width/3.0, height/1.6 , -30, 15, b, m*0.25 );
     draw_triangle(g, std::max(width/3.0, width/3.0-(300*scale)), height/1.6 , -30, 15, b, m*0.25 );
     draw_triangle(g, std::max(width/3.0, width/3.0-(600*scale)), height/1.6 , -30, 15, b, m*0.25 );
@@ -175,17 +215,13 @@ void TunerDisplay::draw_empty_freq(juce::Graphics& g, int width, int height)  no
 void TunerDisplay::draw_triangle(juce::Graphics& g, int x, int y, int w, int h, float c, int match) {
     if (!match) g.setColour(juce::Colours::green.withBrightness(0.7f));
     else g.setColour(juce::Colour::fromRGBA(66*c, 162*c, 200*c, 188*c));
-    juce::Path triangle; 
-    triangle.addTriangle(x, y, x + w, y+h, x + w, y - h); 
-    g.fillPath(triangle);
+    // the paths are made in resized() for w = -30/30, h = 15
+    jassert(std::abs(w) == 30 && h == 15);
+    g.fillPath(w < 0 ? left_triangle : right_triangle, juce::AffineTransform::translation(x, y));
 }
 
 void TunerDisplay::on_tuner_freq_changed() noexcept {
     freq = machine->get_tuner_freq();
-    juce::MessageManagerLock *mmLock;
-    mmLock = new juce::MessageManagerLock;
-    repaint();
-    delete mmLock;
 }
 
 void TunerDisplay::on_ref_freq_changed(float value) noexcept {
@@ -199,10 +235,7 @@ void TunerDisplay::on_tunning_changed(int value) noexcept {
 
 void TunerDisplay::on_use_changed(bool value) noexcept {
     use = value;
-    juce::MessageManagerLock *mmLock;
-    mmLock = new juce::MessageManagerLock;
-    repaint();
-    delete mmLock;
+    dirty = true;
 }
 
 int TunerDisplay::get_tuner_temperament() noexcept {
@@ -21,6 +21,7 @@
 
 #include <JuceHeader.h>
 #include "guitarix.h"
+#include <atomic>
 
 
 class TunerDisplay : public juce::Component, public sigc::trackable
@@ -30,6 +31,7 @@ public:
     virtual ~TunerDisplay();
 
     void paint(juce::Graphics& g) override;
+    void resized() override;
 
 private:
     gx_engine::GxMachine *machine;
@@ -37,14 +39,23 @@ private:
     sigc::connection ref_freq_conn;
     sigc::connection tunning_conn;
     sigc::connection use_conn;
-    float freq;
+    // set by the tuner, painted by the shared display refresh when the
+    // shown value changed or the dots are moving
+    std::atomic<float> freq;
+    std::atomic<bool> dirty;
+    float painted_freq;
     float ref_freq;
     int tunning;
     int temp_adjust;
-    bool use;
+    std::atomic<bool> use;
     juce::Font font;
     int move;
     int smove;
+    // background with the dot row and the triangles, made in resized()
+    juce::Image background;
+    juce::Path left_triangle, right_triangle;
+
+    void refresh();
 
     void draw_dots(juce::Graphics& g, int width, int height, int m)  noexcept;
     void draw_empty_freq(juce::Graphics& g, int width, int height) noexcept;
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "UiDescription.h"
+#include <map>
+
+typedef std::pair<const PluginDef*, std::string> Key;
+struct CacheEntry
+{
+    std::shared_ptr<const UiDescription> d;   // null while being recorded
+    const void *engine;
+};
+static std::map<Key, CacheEntry> descriptions;
+static juce::CriticalSection descriptions_cs;
+
+static juce::ThreadPool& get_pool()
+{
+    static juce::ThreadPool pool(juce::jlimit(1, 4, juce::SystemStats::getNumCpus() - 1));
+    return pool;
+}
+
+// the description load_ui() of this thread records into
+static thread_local UiDescription *recording = 0;
+
+template <UiDescription::Fn fn> static void rec0() { recording->add(fn); }
+template <UiDescription::Fn fn> static void rec1(const char *a) { recording->add(fn, a); }
+template <UiDescription::Fn fn> static void rec2(const char *a, const char *b) { recording->add(fn, a, b); }
+template <UiDescription::Fn fn> static void rec3(const char *a, const char *b, const char *c) { recording->add(fn, a, b, c); }
+static void rec_flags(int flags) { recording->add(UiDescription::set_next_flags, 0, 0, 0, flags); }
+// JuceUiBuilder doesn't use glade files
+static void rec_glade(const char *) {}
+
+void UiDescription::add(Fn fn, const char *a0, const char *a1, const char *a2, int flags)
+{
+    Call c;
+    c.fn = fn;
+    c.flags = flags;
+    c.nulls = 0;
+    const char *a[3] = { a0, a1, a2 };
+    for (int i = 0; i < 3; i++) {
+        if (a[i])
+            c.arg[i] = a[i];
+        else
+            c.nulls |= 1u << i;
+    }
+    calls.push_back(std::move(c));
+}
+
+std::shared_ptr<const UiDescription> UiDescription::record(PluginDef *pd)
+{
+    auto d = std::make_shared<UiDescription>();
+    UiBuilder b = UiBuilder();
+    b.plugin = pd;
+    b.load_glade = rec_glade;
+    b.load_glade_file = rec_glade;
+    b.openTabBox = rec1<open_tab_box>;
+    b.openVerticalBox = rec1<open_vertical_box>;
+    b.openVerticalBox1 = rec1<open_vertical_box1>;
+    b.openVerticalBox2 = rec1<open_vertical_box2>;
+    b.openHorizontalBox = rec1<open_horizontal_box>;
+    b.openHorizontalhideBox = rec1<open_horizontal_hide_box>;
+    b.openHorizontalTableBox = rec1<open_horizontal_table_box>;
+    b.openFrameBox = rec1<open_frame_box>;
+    b.openFlipLabelBox = rec1<open_flip_label_box>;
+    b.openpaintampBox = rec1<open_paintamp_box>;
+    b.closeBox = rec0<close_box>;
+    b.insertSpacer = rec0<insert_spacer>;
+    b.set_next_flags = rec_flags;
+    b.create_big_rackknob = rec2<big_rackknob>;
+    b.create_mid_rackknob = rec2<mid_rackknob>;
+    b.create_small_rackknob = rec2<small_rackknob>;
+    b.create_small_rackknobr = rec2<small_rackknobr>;
+    b.create_master_slider = rec2<master_slider>;
+    b.create_feedback_slider = rec2<feedback_slider>;
+    b.create_selector_no_caption = rec1<selector_no_caption>;
+    b.create_selector = rec2<selector>;
+    b.create_simple_meter = rec1<simple_meter>;
+    b.create_simple_c_meter = rec3<simple_c_meter>;
+    b.create_spin_value = rec2<spin_value>;
+    b.create_switch_no_caption = rec2<switch_no_caption>;
+    b.create_feedback_switch = rec2<feedback_switch>;
+    b.create_fload_switch = rec3<fload_switch>;
+    b.create_switch = rec3<switch_caption>;
+    b.create_wheel = rec2<wheel>;
+    b.create_port_display = rec2<port_display>;
+    b.create_p_display = rec3<p_display>;
+    b.create_simple_spin_value = rec1<simple_spin_value>;
+    b.create_eq_rackslider_no_caption = rec1<eq_rackslider_no_caption>;
+
+    UiDescription *previous = recording;
+    recording = d.get();
+    pd->load_ui(b, UI_FORM_STACK);
+    recording = previous;
+    return d;
+}
+
+// records one unit of an engine in the pool
+class RecordJob : public juce::ThreadPoolJob
+{
+public:
+    RecordJob(const void *e, PluginDef *p)
+        : juce::ThreadPoolJob(p->id), engine(e), pd(p), key(p, p->id) {}
+
+    JobStatus runJob() override
+    {
+        auto d = UiDescription::record(pd);
+        const juce::ScopedLock lock(descriptions_cs);
+        // not when cancelled or already recorded by get()
+        auto i = descriptions.find(key);
+        if (i != descriptions.end() && !i->second.d)
+            i->second.d = d;
+        return jobHasFinished;
+    }
+
+    const void *engine;
+
+private:
+    PluginDef *pd;
+    Key key;
+};
+
+class EngineJobs : public juce::ThreadPool::JobSelector
+{
+public:
+    explicit EngineJobs(const void *e) : engine(e) {}
+    bool isJobSuitable(juce::ThreadPoolJob *job) override
+    {
+        auto *r = dynamic_cast<RecordJob*>(job);
+        return r && r->engine == engine;
+    }
+private:
+    const void *engine;
+};
+
+void UiDescription::replay(const UiBuilder& b) const
+{
+    for (auto& c : calls) {
+        const char *a0 = arg(c, 0), *a1 = arg(c, 1), *a2 = arg(c, 2);
+        switch (c.fn) {
+        case open_tab_box:              b.openTabBox(a0); break;
+        case open_vertical_box:         b.openVerticalBox(a0); break;
+        case open_vertical_box1:        b.openVerticalBox1(a0); break;
+        case open_vertical_box2:        b.openVerticalBox2(a0); break;
+        case open_horizontal_box:       b.openHorizontalBox(a0); break;
+        case open_horizontal_hide_box:  b.openHorizontalhideBox(a0); break;
+        case open_horizontal_table_box: b.openHorizontalTableBox(a0); break;
+        case open_frame_box:            b.openFrameBox(a0); break;
+        case open_flip_label_box:       b.openFlipLabelBox(a0); break;
+        case open_paintamp_box:         b.openpaintampBox(a0); break;
+        case close_box:                 b.closeBox(); break;
+        case insert_spacer:             b.insertSpacer(); break;
+        case set_next_flags:            b.set_next_flags(c.flags); break;
+        case big_rackknob:              b.create_big_rackknob(a0, a1); break;
+        case mid_rackknob:              b.create_mid_rackknob(a0, a1); break;
+        case small_rackknob:            b.create_small_rackknob(a0, a1); break;
+        case small_rackknobr:           b.create_small_rackknobr(a0, a1); break;
+        case master_slider:             b.create_master_slider(a0, a1); break;
+        case feedback_slider:           b.create_feedback_slider(a0, a1); break;
+        case selector_no_caption:       b.create_selector_no_caption(a0); break;
+        case selector:                  b.create_selector(a0, a1); break;
+        case simple_meter:              b.create_simple_meter(a0); break;
+        case simple_c_meter:            b.create_simple_c_meter(a0, a1, a2); break;
+        case spin_value:                b.create_spin_value(a0, a1); break;
+        case switch_no_caption:         b.create_switch_no_caption(a0, a1); break;
+        case feedback_switch:           b.create_feedback_switch(a0, a1); break;
+        case fload_switch:              b.create_fload_switch(a0, a1, a2); break;
+        case switch_caption:            b.create_switch(a0, a1, a2); break;
+        case wheel:                     b.create_wheel(a0, a1); break;
+        case port_display:              b.create_port_display(a0, a1); break;
+        case p_display:                 b.create_p_display(a0, a1, a2); break;
+        case simple_spin_value:         b.create_simple_spin_value(a0); break;
+        case eq_rackslider_no_caption:  b.create_eq_rackslider_no_caption(a0); break;
+        }
+    }
+}
+
+void UiDescription::prepare(const void *engine, const std::vector<PluginDef*>& pdefs)
+{
+    for (PluginDef *pd : pdefs) {
+        if (!pd || !pd->load_ui)
+            continue;
+        Key key(pd, pd->id);
+        {
+            const juce::ScopedLock lock(descriptions_cs);
+            if (descriptions.count(key))
+                continue;
+            descriptions[key] = { nullptr, engine };
+        }
+        get_pool().addJob(new RecordJob(engine, pd), true);
+    }
+}
+
+std::shared_ptr<const UiDescription> UiDescription::get(const void *engine, PluginDef *pd)
+{
+    Key key(pd, pd->id);
+    {
+        const juce::ScopedLock lock(descriptions_cs);
+        auto i = descriptions.find(key);
+        if (i != descriptions.end() && i->second.d)
+            return i->second.d;
+    }
+    auto d = record(pd);
+    const juce::ScopedLock lock(descriptions_cs);
+    auto i = descriptions.find(key);
+    if (i == descriptions.end())
+        i = descriptions.emplace(key, CacheEntry{ nullptr, engine }).first;
+    if (!i->second.d)
+        i->second.d = d;
+    return i->second.d;
+}
+
+void UiDescription::forget(const void *engine)
+{
+    EngineJobs jobs(engine);
+    get_pool().removeAllJobs(true, 5000, &jobs);
+    const juce::ScopedLock lock(descriptions_cs);
+    for (auto i = descriptions.begin(); i != descriptions.end(); ) {
+        if (i->second.engine == engine)
+            i = descriptions.erase(i);
+        else
+            ++i;
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2022 Maxim Alexanian
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "guitarix.h"
+
+//==============================================================================
+/*
+** What the load_ui() of a rack unit builds, as the list of its UiBuilder
+** calls with copies of their arguments.
+**
+** Recording runs load_ui() with a builder that only stores the calls, so
+** it doesn't need the message thread: prepare() records the units of a
+** rack in parallel on a small thread pool that all editors of the process
+** share. The message thread replays a description into a JuceUiBuilder,
+** which makes and attaches the components.
+**
+** Descriptions are kept by PluginDef and id, together with the engine
+** that asked for them. The widgets keep pointers to the id strings, so a
+** replayed description has to live as long as they do. The recording jobs
+** use the PluginDefs: forget() an engine before its definitions change or
+** are deleted, it cancels only the jobs of that engine and drops its
+** descriptions.
+*/
+class UiDescription
+{
+public:
+    // records the units not known yet in the background, message thread
+    static void prepare(const void *engine, const std::vector<PluginDef*>& pdefs);
+    // the description of pd, recorded right here when it isn't ready yet
+    static std::shared_ptr<const UiDescription> get(const void *engine, PluginDef *pd);
+    static void forget(const void *engine);
+
+    static std::shared_ptr<const UiDescription> record(PluginDef *pd);
+    void replay(const UiBuilder& b) const;
+
+    enum Fn {
+        open_tab_box, open_vertical_box, open_vertical_box1, open_vertical_box2,
+        open_horizontal_box, open_horizontal_hide_box, open_horizontal_table_box,
+        open_frame_box, open_flip_label_box, open_paintamp_box, close_box,
+        insert_spacer, set_next_flags,
+        big_rackknob, mid_rackknob, small_rackknob, small_rackknobr,
+        master_slider, feedback_slider, selector_no_caption, selector,
+        simple_meter, simple_c_meter, spin_value, switch_no_caption,
+        feedback_switch, fload_switch, switch_caption, wheel, port_display,
+        p_display, simple_spin_value, eq_rackslider_no_caption
+    };
+
+    void add(Fn fn, const char *a0 = 0, const char *a1 = 0, const char *a2 = 0, int flags = 0);
+
+private:
+    struct Call
+    {
+        Fn fn;
+        int flags;
+        unsigned nulls;
+        std::string arg[3];
+    };
+
+    const char* arg(const Call& c, int i) const { return (c.nulls & (1u << i)) ? 0 : c.arg[i].c_str(); }
+
+    std::vector<Call> calls;
+};